@@ -57,7 +57,6 @@
  */
 struct file_info {
   struct file_info *next;
-  struct stat	st;
   char*	fn;
 };
 
@@ -126,57 +125,6 @@ file_info_find_name(struct file_info *list, const char *filename)
   return NULL;
 }
 
-/*
- * Read the next filename from a filedescriptor and create a file_info struct
- * for it. If there is nothing to read return NULL.
- */
-static struct file_info *
-getfi(const char *root, int fd)
-{
-  static char* fn = NULL;
-  static size_t fnlen = 0;
-  size_t i= 0;
-  struct file_info *fi;
-  size_t rl = strlen(root);
-
-  if (fn == NULL) {
-    fnlen = rl + MAXFILENAME;
-    fn = m_malloc(fnlen);
-  } else if (fnlen < (rl + MAXFILENAME)) {
-    fnlen = rl + MAXFILENAME;
-    fn = m_realloc(fn, fnlen);
-  }
-  i=sprintf(fn,"%s/",root);
-  
-  while (1) {
-    int	res;
-    if (i>=fnlen) {
-      fnlen += MAXFILENAME;
-      fn = m_realloc(fn, fnlen);
-    }
-    if ((res=read(fd, (fn+i), sizeof(*fn)))<0) {
-      if ((errno==EINTR) || (errno==EAGAIN))
-	continue;
-      else
-	return NULL;
-    }
-    if (res==0)	// EOF -> parent died
-      return NULL;
-    if (fn[i] == '\0')
-      break;
-
-    i++;
-
-    if (i >= MAXFILENAME)
-      ohshit(_("file name '%.50s...' is too long"), fn + rl + 1);
-  }
-
-  fi = file_info_new(fn + rl + 1);
-  lstat(fn, &(fi->st));
-
-  return fi;
-}
-
 /*
  * Add a new file_info struct to a single linked list of file_info structs.
  * We perform a slight optimization to work around a `feature' in tar: tar
@@ -221,19 +169,16 @@ void do_build(const char *const *argv) {
   
   char *m;
   const char *debar, *directory, *const *mscriptp, *versionstring, *arch;
-  char *controlfile, *tfbuf;
+  char *controlfile, *controldir, *tfbuf;
   const char *envbuf;
   struct pkginfo *checkedinfo;
   struct arbitraryfield *field;
   FILE *ar, *cf;
-  int p1[2],p2[2],p3[2], warns, errs, n, c, subdir, gzfd;
-  pid_t c1,c2,c3;
+  int p1[2], warns, errs, n, c, subdir, gzfd;
+  pid_t c1;
   struct stat controlstab, datastab, mscriptstab, debarstab;
   char conffilename[MAXCONFFILENAME+1];
   time_t thetime= 0;
-  struct file_info *fi;
-  struct file_info *symlist = NULL;
-  struct file_info *symlist_end = NULL;
   
 /* Decode our arguments */
   directory = *argv++;
@@ -410,17 +355,6 @@ void do_build(const char *const *argv) {
   if (!(ar=fopen(debar,"wb"))) ohshite(_("unable to create `%.255s'"),debar);
   if (setvbuf(ar, NULL, _IONBF, 0))
     ohshite(_("unable to unbuffer `%.255s'"), debar);
-  /* Fork a tar to package the control-section of the package */
-  unsetenv("TAR_OPTIONS");
-  m_pipe(p1);
-  if (!(c1= m_fork())) {
-    m_dup2(p1[1],1); close(p1[0]); close(p1[1]);
-    if (chdir(directory)) ohshite(_("failed to chdir to `%.255s'"),directory);
-    if (chdir(BUILDCONTROLDIR)) ohshite(_("failed to chdir to .../DEBIAN"));
-    execlp(TAR, "tar", "-cf", "-", "--format=gnu", ".", NULL);
-    ohshite(_("failed to exec tar -cf"));
-  }
-  close(p1[1]);
   /* Create a temporary file to store the control data in. Immediately unlink
    * our temporary file so others can't mess with it.
    */
@@ -431,14 +365,19 @@ void do_build(const char *const *argv) {
   /* reset this, so we can use it elsewhere */
   strcpy(tfbuf,envbuf);
   strcat(tfbuf,"/dpkg.XXXXXX");
-  /* And run gzip to compress our control archive */
-  if (!(c2= m_fork())) {
-    m_dup2(p1[0],0); m_dup2(gzfd,1); close(p1[0]); close(gzfd);
+  /* Fork a gzip to compress our control archive, which we write ourselves */
+  m_pipe(p1);
+  if (!(c1= m_fork())) {
+    m_dup2(p1[0],0); m_dup2(gzfd,1); close(p1[0]); close(p1[1]); close(gzfd);
     compress_cat(compress_type_gzip, 0, 1, "9", _("control"));
   }
   close(p1[0]);
-  waitsubproc(c2,"gzip -9c",0);
-  waitsubproc(c1,"tar -cf",0);
+  controldir= m_malloc(strlen(directory) + sizeof(BUILDCONTROLDIR) + 1);
+  sprintf(controldir, "%s/%s", directory, BUILDCONTROLDIR);
+  tar_write_tree(p1[1], controldir, NULL, _("control"));
+  free(controldir);
+  close(p1[1]);
+  waitsubproc(c1,"gzip -9c",0);
   if (fstat(gzfd,&controlstab)) ohshite(_("failed to fstat tmpfile (control)"));
   /* We have our first file for the ar-archive. Write a header for it to the
    * package and insert it.
@@ -478,61 +417,19 @@ void do_build(const char *const *argv) {
     strcpy(tfbuf,envbuf);
     strcat(tfbuf,"/dpkg.XXXXXX");
   }
-  /* Fork off a tar. We will feed it a list of filenames on stdin later.
+  /* Fork off the compressor, and feed it the data archive, which we write
+   * ourselves.
    */
   m_pipe(p1);
-  m_pipe(p2);
   if (!(c1= m_fork())) {
     m_dup2(p1[0],0); close(p1[0]); close(p1[1]);
-    m_dup2(p2[1],1); close(p2[0]); close(p2[1]);
-    if (chdir(directory)) ohshite(_("failed to chdir to `%.255s'"),directory);
-    execlp(TAR, "tar", "-cf", "-", "--format=gnu", "--null", "-T", "-", "--no-recursion", NULL);
-    ohshite(_("failed to exec tar -cf"));
-  }
-  close(p1[0]);
-  close(p2[1]);
-  /* Of course we should not forget to compress the archive as well.. */
-  if (!(c2= m_fork())) {
-    close(p1[1]);
-    m_dup2(p2[0],0); close(p2[0]);
     m_dup2(oldformatflag ? fileno(ar) : gzfd,1);
     compress_cat(compress_type, 0, 1, compression, _("data"));
   }
-  close(p2[0]);
-  /* All the pipes are set, now lets run find, and start feeding
-   * filenames to tar.
-   */
-
-  m_pipe(p3);
-  if (!(c3= m_fork())) {
-    m_dup2(p3[1],1); close(p3[0]); close(p3[1]);
-    if (chdir(directory)) ohshite(_("failed to chdir to `%.255s'"),directory);
-    execlp(FIND, "find", ".", "-path", "./" BUILDCONTROLDIR, "-prune", "-o",
-           "-print0", NULL);
-    ohshite(_("failed to exec find"));
-  }
-  close(p3[1]);
-  /* We need to reorder the files so we can make sure that symlinks
-   * will not appear before their target.
-   */
-  while ((fi=getfi(directory, p3[0]))!=NULL)
-    if (S_ISLNK(fi->st.st_mode))
-      add_to_filist(&symlist, &symlist_end, fi);
-    else {
-      if (write(p1[1], fi->fn, strlen(fi->fn)+1) ==- 1)
-	ohshite(_("failed to write filename to tar pipe (data)"));
-    }
-  close(p3[0]);
-  waitsubproc(c3,"find",0);
-
-  for (fi= symlist;fi;fi= fi->next)
-    if (write(p1[1], fi->fn, strlen(fi->fn)+1) == -1)
-      ohshite(_("failed to write filename to tar pipe (data)"));
-  /* All done, clean up wait for tar and gzip to finish their job */
+  close(p1[0]);
+  tar_write_tree(p1[1], directory, BUILDCONTROLDIR, _("data"));
   close(p1[1]);
-  free_filist(symlist);
-  waitsubproc(c2, _("<compress> from tar -cf"), 0);
-  waitsubproc(c1,"tar -cf",0);
+  waitsubproc(c1, _("<compress> from tar -cf"), 0);
   /* Okay, we have data.tar.gz as well now, add it to the ar wrapper */
   if (!oldformatflag) {
     const char *datamember;
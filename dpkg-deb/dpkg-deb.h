@@ -34,6 +34,9 @@ extern dofunction *action;
 void extracthalf(const char *debar, const char *directory,
                  const char *taroption, int admininfo);
 
+void tar_write_tree(int fd, const char *root, const char *exclude,
+                    const char *desc);
+
 extern const char *compression;
 extern const char* showformat;
 extern enum compress_type compress_type;
@@ -50,13 +50,11 @@
 
 static void movecontrolfiles(const char *thing) {
   char buf[200];
+  const char *args[]= { "sh", "-c", buf, NULL };
   pid_t c1;
   
   sprintf(buf, "mv %s/* . && rmdir %s", thing, thing);
-  if (!(c1= m_fork())) {
-    execlp("sh", "sh", "-c", buf, NULL);
-    ohshite(_("failed to exec sh -c mv foo/* &c"));
-  }
+  c1= subproc_spawn("sh -c mv foo/* &c", "sh", args, NULL);
   waitsubproc(c1,"sh -c mv foo/* &c",0);
 }
 
@@ -277,8 +275,17 @@ void extracthalf(const char *debar, const char *directory,
   } else {
     m_pipe(p1);
     if (!(c1= m_fork())) {
+      off_t memberpos;
+
       close(p1[0]);
-      stream_fd_copy(ar, p1[1], memberlen, _("failed to write to pipe in copy"));
+      /* If the archive is seekable, hand the member over to the kernel
+       * to copy into the pipe, rather than going through stdio. */
+      memberpos= ftello(ar);
+      if (memberpos != -1 && lseek(fileno(ar), memberpos, SEEK_SET) != -1)
+        fd_fd_copy(fileno(ar), p1[1], memberlen,
+                   _("failed to write to pipe in copy"));
+      else
+        stream_fd_copy(ar, p1[1], memberlen, _("failed to write to pipe in copy"));
       if (close(p1[1]) == EOF) ohshite(_("failed to close pipe in copy"));
       exit(0);
     }
@@ -309,20 +316,20 @@ void extracthalf(const char *debar, const char *directory,
   }
 
   if (taroption) {
-    if (!(c3= m_fork())) {
-      char buffer[30+2];
-      if (strlen(taroption) > 30)
-        internerr("taroption is too long '%s'", taroption);
-      strcpy(buffer, taroption);
-      strcat(buffer, "f");
-      m_dup2(p2[0],0);
-      close(p2[0]);
-
-      unsetenv("TAR_OPTIONS");
-
-      execlp(TAR, "tar", buffer, "-", NULL);
-      ohshite(_("failed to exec tar"));
-    }
+    struct subproc_spawn sp = SUBPROC_SPAWN_INIT;
+    char buffer[30+2];
+    const char *args[]= { "tar", buffer, "-", NULL };
+
+    if (strlen(taroption) > 30)
+      internerr("taroption is too long '%s'", taroption);
+    strcpy(buffer, taroption);
+    strcat(buffer, "f");
+
+    /* We are done with the environment by now, apart from tar. */
+    unsetenv("TAR_OPTIONS");
+
+    sp.fd[0]= p2[0];
+    c3= subproc_spawn("tar", TAR, args, &sp);
     close(p2[0]);
     waitsubproc(c3,"tar",0);
   }
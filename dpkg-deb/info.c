@@ -46,6 +46,8 @@
 #include "dpkg-deb.h"
 
 static void cu_info_prepare(int argc, void **argv) {
+  struct subproc_spawn sp = SUBPROC_SPAWN_INIT;
+  const char *args[]= { "rm", "-rf", NULL, NULL };
   pid_t c1;
   int status;
   char *directory;
@@ -54,11 +56,11 @@ static void cu_info_prepare(int argc, void **argv) {
   directory= (char*)(argv[0]);
   if (chdir("/")) { perror(_("failed to chdir to `/' for cleanup")); return; }
   if (lstat(directory,&stab) && errno==ENOENT) return;
-  if ((c1= fork()) == -1) { perror(_("failed to fork for cleanup")); return; }
-  if (!c1) {
-    execlp(RM, "rm", "-rf", directory, NULL);
-    perror(_("failed to exec rm for cleanup")); _exit(1);
-  }
+  args[2]= directory;
+  /* We are a cleanup, so we must not throw if rm cannot be started. */
+  sp.nonfatal= true;
+  c1= subproc_spawn("rm -rf", RM, args, &sp);
+  if (c1 == -1) { perror(_("failed to fork for cleanup")); return; }
   if (waitpid(c1,&status,0) != c1) { perror(_("failed to wait for rm cleanup")); return; }
   if (status) { fprintf(stderr,_("rm cleanup failed, code %d\n"),status); }
 } 
@@ -77,9 +79,10 @@ static void info_prepare(const char *const **argvp,
     ohshite(_("failed to make temporary directoryname"));
   *directoryp= dbuf;
 
-  if (!(c1= m_fork())) {
-    execlp(RM, "rm", "-rf", dbuf, NULL);
-    ohshite(_("failed to exec rm -rf"));
+  {
+    const char *args[]= { "rm", "-rf", dbuf, NULL };
+
+    c1= subproc_spawn("rm -rf", RM, args, NULL);
   }
   waitsubproc(c1,"rm -rf",0);
   push_cleanup(cu_info_prepare, -1, NULL, 0, 1, (void *)dbuf);
@@ -0,0 +1,95 @@
+#!/bin/sh
+#
+# dpkg-deb - construction and deconstruction of *.deb archives
+# t-tarwrite.sh - check the in-process tar writer against tar
+#
+# This is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as
+# published by the Free Software Foundation; either version 2,
+# or (at your option) any later version.
+#
+# This is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public
+# License along with dpkg; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+# Builds a package with dpkg-deb -b, and checks that tar reads back from
+# --fsys-tarfile the same members, with the same contents and metadata,
+# as it does from an archive of the same tree it wrote itself.
+
+set -e
+
+dpkg_deb=${DPKG_DEB:-./dpkg-deb}
+
+tmp=$(mktemp -d "${TMPDIR:-/tmp}/t-tarwrite.XXXXXX")
+trap 'rm -rf "$tmp"' EXIT
+
+pkg=$tmp/pkg
+long=$(awk 'BEGIN { for (i = 0; i < 30; i++) printf("long%d", i) }')
+
+mkdir -p "$pkg/DEBIAN" "$pkg/usr/share/$long/sub" "$pkg/etc"
+cat >"$pkg/DEBIAN/control" <<EOF
+Package: t-tarwrite
+Version: 1.0
+Architecture: all
+Maintainer: test <test@localhost>
+Description: tar writer round trip test
+EOF
+
+echo plain >"$pkg/etc/plain"
+echo readonly >"$pkg/etc/readonly"
+chmod 0444 "$pkg/etc/readonly"
+: >"$pkg/etc/empty"
+dd if=/dev/zero of="$pkg/etc/blocks" bs=1024 count=13 2>/dev/null
+echo long >"$pkg/usr/share/$long/sub/$long"
+ln "$pkg/etc/plain" "$pkg/etc/hardlink"
+ln -s plain "$pkg/etc/symlink"
+ln -s "../usr/share/$long/sub/$long" "$pkg/etc/longsymlink"
+
+# An mtime that does not fit in the octal field, only if the file system
+# can represent it.
+touch -d '2300-01-01 00:00:00 UTC' "$pkg/etc/future" 2>/dev/null ||
+	touch "$pkg/etc/future"
+
+# Ids that do not fit in the octal field, only if we can set them.
+if [ "$(id -u)" = 0 ]; then
+	echo owned >"$pkg/etc/owned"
+	chown 3000000:3000000 "$pkg/etc/owned"
+fi
+
+"$dpkg_deb" -b "$pkg" "$tmp/t.deb" >/dev/null
+"$dpkg_deb" --fsys-tarfile "$tmp/t.deb" >"$tmp/got.tar"
+(cd "$pkg" && tar --sort=name --exclude=./DEBIAN -cf - .) >"$tmp/expected.tar"
+
+# Compares the member lists, sorted as the writer puts symlinks last.
+list()
+{
+	tar -tvf "$1" --numeric-owner | sort
+}
+
+list "$tmp/expected.tar" >"$tmp/expected.list"
+list "$tmp/got.tar" >"$tmp/got.list"
+diff -u "$tmp/expected.list" "$tmp/got.list"
+
+# Compares what tar extracts from both archives.
+mkdir "$tmp/expected" "$tmp/got"
+tar -xf "$tmp/expected.tar" -C "$tmp/expected" --warning=no-timestamp
+tar -xf "$tmp/got.tar" -C "$tmp/got" --warning=no-timestamp
+
+# Directory mtimes are left out, as tar restores them when it leaves the
+# directory in the archive, before the symlinks are created.
+tree()
+{
+	(cd "$1" &&
+	 find . \( -type d -printf '%p %y %m %U %G\n' \) -o \
+	        -printf '%p %y %m %U %G %T@ %n %l\n' | sort)
+}
+
+tree "$tmp/expected" >"$tmp/expected.tree"
+tree "$tmp/got" >"$tmp/got.tree"
+diff -u "$tmp/expected.tree" "$tmp/got.tree"
+diff -r --no-dereference "$tmp/expected" "$tmp/got"
@@ -0,0 +1,511 @@
+/*
+ * dpkg-deb - construction and deconstruction of *.deb archives
+ * tarwrite.c - in-process tar archive writer
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with dpkg; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <config.h>
+#include <compat.h>
+
+#include <dpkg/i18n.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pwd.h>
+#include <grp.h>
+
+#include <dpkg/dpkg.h>
+#include <dpkg/dpkg-db.h>
+#include <dpkg/buffer.h>
+#include <dpkg/tarfn.h>
+
+#include "dpkg-deb.h"
+
+#define TAR_MAGIC_GNU		"ustar  "
+#define TAR_LONGLINK_NAME	"././@LongLink"
+
+struct tar_header {
+	char name[100];
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char size[12];
+	char mtime[12];
+	char checksum[8];
+	char linkflag;
+	char linkname[100];
+	char magic[8];
+	char uname[32];
+	char gname[32];
+	char devmajor[8];
+	char devminor[8];
+	char pad[167];
+};
+
+struct tar_symlink {
+	struct tar_symlink *next;
+	struct stat st;
+	char *name;
+	char *linkname;
+};
+
+struct tar_hardlink {
+	struct tar_hardlink *next;
+	dev_t dev;
+	ino_t ino;
+	char *name;
+};
+
+struct tar_writer {
+	int fd;
+	const char *desc;
+	const char *exclude;
+
+	/* Pathname of the current entry, always starting with "./". */
+	struct varbuf path;
+
+	/* Symlinks are emitted last so they never precede their target. */
+	struct tar_symlink *symlinks;
+	struct tar_symlink **symlinks_tail;
+	struct tar_hardlink *hardlinks;
+
+	/* Single entry caches, trees are nearly always owned by one user. */
+	bool uname_valid, gname_valid;
+	uid_t uname_uid;
+	gid_t gname_gid;
+	char uname[32];
+	char gname[32];
+};
+
+static const char tar_zero_block[TARBLKSZ];
+
+static void
+tar_write(struct tar_writer *w, const void *buf, size_t len)
+{
+	const char *p = buf;
+
+	while (len > 0) {
+		ssize_t n;
+
+		n = write(w->fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			ohshite(_("failed to write tar archive (%s)"), w->desc);
+		}
+		p += n;
+		len -= n;
+	}
+}
+
+static void
+tar_pad(struct tar_writer *w, off_t size)
+{
+	size_t rem = size % TARBLKSZ;
+
+	if (rem)
+		tar_write(w, tar_zero_block, TARBLKSZ - rem);
+}
+
+/*
+ * Store value as a NUL terminated octal number, or if it does not fit,
+ * in the GNU base-256 encoding: big-endian two's complement with the
+ * high bit of the first byte set.
+ */
+static void
+tar_number(char *field, size_t size, long long value)
+{
+	char buf[32];
+	size_t i;
+
+	if (value >= 0 &&
+	    snprintf(buf, sizeof(buf), "%0*llo", (int)size - 1,
+	             (unsigned long long)value) < (int)size) {
+		memcpy(field, buf, size);
+		return;
+	}
+
+	for (i = size; i-- > 0; ) {
+		field[i] = value & 0xff;
+		value >>= 8;
+	}
+	field[0] |= 0x80;
+}
+
+/*
+ * Copy str into a header field, truncated to its size. The header is
+ * zeroed beforehand, so a string shorter than the field is terminated.
+ */
+static void
+tar_string(char *field, size_t size, const char *str)
+{
+	size_t len = strlen(str);
+
+	memcpy(field, str, len < size ? len : size);
+}
+
+static void
+tar_cache_name(char *cache, size_t size, const char *name)
+{
+	size_t len = strlen(name);
+
+	if (len >= size)
+		len = size - 1;
+	memcpy(cache, name, len);
+	cache[len] = '\0';
+}
+
+static const char *
+tar_uname(struct tar_writer *w, uid_t uid)
+{
+	struct passwd *pw;
+
+	if (w->uname_valid && w->uname_uid == uid)
+		return w->uname;
+
+	pw = getpwuid(uid);
+	if (pw)
+		tar_cache_name(w->uname, sizeof(w->uname), pw->pw_name);
+	else
+		w->uname[0] = '\0';
+	w->uname_uid = uid;
+	w->uname_valid = true;
+
+	return w->uname;
+}
+
+static const char *
+tar_gname(struct tar_writer *w, gid_t gid)
+{
+	struct group *gr;
+
+	if (w->gname_valid && w->gname_gid == gid)
+		return w->gname;
+
+	gr = getgrgid(gid);
+	if (gr)
+		tar_cache_name(w->gname, sizeof(w->gname), gr->gr_name);
+	else
+		w->gname[0] = '\0';
+	w->gname_gid = gid;
+	w->gname_valid = true;
+
+	return w->gname;
+}
+
+static void
+tar_header_finish(struct tar_writer *w, struct tar_header *h)
+{
+	const unsigned char *s = (const unsigned char *)h;
+	unsigned int sum = 0;
+	size_t i;
+
+	memcpy(h->magic, TAR_MAGIC_GNU, sizeof(h->magic));
+	memset(h->checksum, ' ', sizeof(h->checksum));
+	for (i = 0; i < sizeof(*h); i++)
+		sum += s[i];
+	sprintf(h->checksum, "%06o", sum);
+	h->checksum[7] = ' ';
+
+	tar_write(w, h, sizeof(*h));
+}
+
+/*
+ * Emit a GNU ././@LongLink pseudo entry carrying a name that does not
+ * fit in the 100 byte header field.
+ */
+static void
+tar_put_longlink(struct tar_writer *w, TarFileType type, const char *name)
+{
+	struct tar_header h;
+	size_t len = strlen(name) + 1;
+
+	memset(&h, 0, sizeof(h));
+	strcpy(h.name, TAR_LONGLINK_NAME);
+	tar_number(h.mode, sizeof(h.mode), 0);
+	tar_number(h.uid, sizeof(h.uid), 0);
+	tar_number(h.gid, sizeof(h.gid), 0);
+	tar_number(h.size, sizeof(h.size), len);
+	tar_number(h.mtime, sizeof(h.mtime), 0);
+	h.linkflag = type;
+	strcpy(h.uname, "root");
+	strcpy(h.gname, "root");
+	tar_header_finish(w, &h);
+
+	tar_write(w, name, len);
+	tar_pad(w, len);
+}
+
+static void
+tar_put_header(struct tar_writer *w, const char *name, const char *linkname,
+               const struct stat *st, TarFileType type, off_t size)
+{
+	struct tar_header h;
+
+	if (strlen(name) >= sizeof(h.name))
+		tar_put_longlink(w, GNU_LONGNAME, name);
+	if (linkname && strlen(linkname) >= sizeof(h.linkname))
+		tar_put_longlink(w, GNU_LONGLINK, linkname);
+
+	memset(&h, 0, sizeof(h));
+	tar_string(h.name, sizeof(h.name), name);
+	if (linkname)
+		tar_string(h.linkname, sizeof(h.linkname), linkname);
+	tar_number(h.mode, sizeof(h.mode), st->st_mode & 07777);
+	tar_number(h.uid, sizeof(h.uid), st->st_uid);
+	tar_number(h.gid, sizeof(h.gid), st->st_gid);
+	tar_number(h.size, sizeof(h.size), size);
+	tar_number(h.mtime, sizeof(h.mtime), st->st_mtime);
+	h.linkflag = type;
+	tar_string(h.uname, sizeof(h.uname), tar_uname(w, st->st_uid));
+	tar_string(h.gname, sizeof(h.gname), tar_gname(w, st->st_gid));
+	if (type == CharacterDevice || type == BlockDevice) {
+		tar_number(h.devmajor, sizeof(h.devmajor), major(st->st_rdev));
+		tar_number(h.devminor, sizeof(h.devminor), minor(st->st_rdev));
+	}
+	tar_header_finish(w, &h);
+}
+
+static const char *
+tar_find_hardlink(struct tar_writer *w, const struct stat *st)
+{
+	struct tar_hardlink *hl;
+
+	for (hl = w->hardlinks; hl; hl = hl->next)
+		if (hl->dev == st->st_dev && hl->ino == st->st_ino)
+			return hl->name;
+
+	hl = m_malloc(sizeof(*hl));
+	hl->dev = st->st_dev;
+	hl->ino = st->st_ino;
+	hl->name = m_strdup(w->path.buf);
+	hl->next = w->hardlinks;
+	w->hardlinks = hl;
+
+	return NULL;
+}
+
+static void
+tar_put_file(struct tar_writer *w, int dirfd, const char *name,
+             const struct stat *st)
+{
+	const char *target;
+	int fd;
+
+	if (st->st_nlink > 1) {
+		target = tar_find_hardlink(w, st);
+		if (target) {
+			tar_put_header(w, w->path.buf, target, st,
+			               HardLink, 0);
+			return;
+		}
+	}
+
+	fd = openat(dirfd, name, O_RDONLY | O_NOFOLLOW);
+	if (fd < 0)
+		ohshite(_("unable to open '%.250s'"), w->path.buf);
+
+	tar_put_header(w, w->path.buf, NULL, st, NormalFile1,
+	               st->st_size);
+	fd_fd_copy(fd, w->fd, st->st_size, _("%s (file '%.250s')"), w->desc,
+	           w->path.buf);
+	tar_pad(w, st->st_size);
+
+	close(fd);
+}
+
+static int
+tar_name_cmp(const void *a, const void *b)
+{
+	return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static void tar_put_dir(struct tar_writer *w, int dirfd);
+
+static void
+tar_put_entry(struct tar_writer *w, int dirfd, const char *name)
+{
+	struct tar_symlink *sl;
+	struct stat st;
+	ssize_t len;
+	int subfd;
+
+	if (fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW))
+		ohshite(_("unable to stat '%.250s'"), w->path.buf);
+
+	if (S_ISDIR(st.st_mode)) {
+		varbufaddc(&w->path, '/');
+		varbufaddc(&w->path, '\0');
+		w->path.used--;
+		tar_put_header(w, w->path.buf, NULL, &st,
+		               Directory, 0);
+
+		subfd = openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+		if (subfd < 0)
+			ohshite(_("unable to open directory '%.250s'"),
+			        w->path.buf);
+		tar_put_dir(w, subfd);
+	} else if (S_ISREG(st.st_mode)) {
+		tar_put_file(w, dirfd, name, &st);
+	} else if (S_ISLNK(st.st_mode)) {
+		sl = m_malloc(sizeof(*sl));
+		sl->st = st;
+		sl->name = m_strdup(w->path.buf);
+		sl->linkname = m_malloc(st.st_size + 1);
+		len = readlinkat(dirfd, name, sl->linkname, st.st_size + 1);
+		if (len < 0)
+			ohshite(_("unable to read link '%.250s'"), w->path.buf);
+		if (len > st.st_size)
+			ohshit(_("symbolic link '%.250s' changed size while "
+			         "reading"), w->path.buf);
+		sl->linkname[len] = '\0';
+		sl->next = NULL;
+		*w->symlinks_tail = sl;
+		w->symlinks_tail = &sl->next;
+	} else if (S_ISCHR(st.st_mode)) {
+		tar_put_header(w, w->path.buf, NULL, &st,
+		               CharacterDevice, 0);
+	} else if (S_ISBLK(st.st_mode)) {
+		tar_put_header(w, w->path.buf, NULL, &st,
+		               BlockDevice, 0);
+	} else if (S_ISFIFO(st.st_mode)) {
+		tar_put_header(w, w->path.buf, NULL, &st,
+		               FIFO, 0);
+	} else {
+		warning(_("'%.250s' is not a file, directory, link or device, "
+		          "ignoring"), w->path.buf);
+	}
+}
+
+/*
+ * Write all entries below dirfd, which gets closed. Entries are sorted
+ * bytewise so the archive does not depend on the readdir order.
+ */
+static void
+tar_put_dir(struct tar_writer *w, int dirfd)
+{
+	DIR *dir;
+	struct dirent *de;
+	char **names = NULL;
+	size_t names_used = 0, names_size = 0, i;
+	size_t path_used = w->path.used;
+
+	dir = fdopendir(dirfd);
+	if (!dir)
+		ohshite(_("unable to open directory '%.250s'"), w->path.buf);
+
+	while ((errno = 0, de = readdir(dir))) {
+		if (strcmp(de->d_name, ".") == 0 ||
+		    strcmp(de->d_name, "..") == 0)
+			continue;
+
+		if (names_used == names_size) {
+			names_size = names_size ? names_size * 2 : 32;
+			names = m_realloc(names, names_size * sizeof(*names));
+		}
+		names[names_used++] = m_strdup(de->d_name);
+	}
+	if (errno)
+		ohshite(_("unable to read directory '%.250s'"), w->path.buf);
+
+	qsort(names, names_used, sizeof(*names), tar_name_cmp);
+
+	for (i = 0; i < names_used; i++) {
+		w->path.used = path_used;
+		varbufaddstr(&w->path, names[i]);
+		varbufaddc(&w->path, '\0');
+		w->path.used--;
+
+		if (w->exclude && strcmp(w->path.buf + 2, w->exclude) == 0)
+			continue;
+
+		tar_put_entry(w, dirfd, names[i]);
+	}
+	w->path.used = path_used;
+	w->path.buf[path_used] = '\0';
+
+	for (i = 0; i < names_used; i++)
+		free(names[i]);
+	free(names);
+
+	closedir(dir);
+}
+
+/*
+ * Write a GNU format tar archive of the tree at root to fd, with member
+ * names relative to root as “./...”, like ‘tar -cf - .’ would. If exclude
+ * is not NULL, the top-level entry with that name is pruned.
+ */
+void
+tar_write_tree(int fd, const char *root, const char *exclude,
+               const char *desc)
+{
+	struct tar_writer w;
+	struct tar_symlink *sl, *sl_next;
+	struct tar_hardlink *hl, *hl_next;
+	struct stat st;
+	int dirfd;
+
+	memset(&w, 0, sizeof(w));
+	w.fd = fd;
+	w.desc = desc;
+	w.exclude = exclude;
+	w.symlinks_tail = &w.symlinks;
+	varbufinit(&w.path, 0);
+
+	dirfd = open(root, O_RDONLY | O_DIRECTORY);
+	if (dirfd < 0)
+		ohshite(_("unable to open directory '%.250s'"), root);
+	if (fstat(dirfd, &st))
+		ohshite(_("unable to stat '%.250s'"), root);
+
+	varbufaddstr(&w.path, "./");
+	varbufaddc(&w.path, '\0');
+	w.path.used--;
+	tar_put_header(&w, w.path.buf, NULL, &st, Directory, 0);
+	tar_put_dir(&w, dirfd);
+
+	for (sl = w.symlinks; sl; sl = sl_next) {
+		sl_next = sl->next;
+		tar_put_header(&w, sl->name, sl->linkname, &sl->st,
+		               SymbolicLink, 0);
+		free(sl->name);
+		free(sl->linkname);
+		free(sl);
+	}
+
+	for (hl = w.hardlinks; hl; hl = hl_next) {
+		hl_next = hl->next;
+		free(hl->name);
+		free(hl);
+	}
+
+	/* End of archive marker. */
+	tar_write(&w, tar_zero_block, TARBLKSZ);
+	tar_write(&w, tar_zero_block, TARBLKSZ);
+
+	varbuffree(&w.path);
+}
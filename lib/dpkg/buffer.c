@@ -27,7 +27,14 @@
 #include <dpkg/i18n.h>
 
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
 #include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -35,23 +42,23 @@
 
 #include <dpkg/dpkg.h>
 #include <dpkg/varbuf.h>
-#include <dpkg/md5.h>
+#include <dpkg/hash.h>
 #include <dpkg/buffer.h>
 
-struct buffer_write_md5ctx {
-	struct MD5Context ctx;
+struct buffer_write_hashctx {
+	struct hash_context ctx;
 	char *hash;
 };
 
 static void
-buffer_md5_init(struct buffer_data *data)
+buffer_hash_init(struct buffer_data *data, enum hash_type type)
 {
-	struct buffer_write_md5ctx *ctx;
+	struct buffer_write_hashctx *ctx;
 
-	ctx = m_malloc(sizeof(struct buffer_write_md5ctx));
+	ctx = m_malloc(sizeof(struct buffer_write_hashctx));
 	ctx->hash = data->arg.ptr;
 	data->arg.ptr = ctx;
-	MD5Init(&ctx->ctx);
+	hash_init(&ctx->ctx, type);
 }
 
 off_t
@@ -59,28 +66,22 @@ buffer_init(struct buffer_data *read_data, struct buffer_data *write_data)
 {
 	switch (write_data->type) {
 	case BUFFER_WRITE_MD5:
-		buffer_md5_init(write_data);
+		buffer_hash_init(write_data, HASH_MD5);
+		break;
+	case BUFFER_WRITE_SHA256:
+		buffer_hash_init(write_data, HASH_SHA256);
 		break;
 	}
 	return 0;
 }
 
 static void
-buffer_md5_done(struct buffer_data *data)
+buffer_hash_done(struct buffer_data *data)
 {
-	struct buffer_write_md5ctx *ctx;
-	unsigned char digest[16], *p = digest;
-	char *hash;
-	int i;
-
-	ctx = (struct buffer_write_md5ctx *)data->arg.ptr;
-	hash = ctx->hash;
-	MD5Final(digest, &ctx->ctx);
-	for (i = 0; i < 16; ++i) {
-		sprintf(hash, "%02x", *p++);
-		hash += 2;
-	}
-	*hash = '\0';
+	struct buffer_write_hashctx *ctx;
+
+	ctx = (struct buffer_write_hashctx *)data->arg.ptr;
+	hash_final(&ctx->ctx, ctx->hash);
 	free(ctx);
 }
 
@@ -89,7 +90,8 @@ buffer_done(struct buffer_data *read_data, struct buffer_data *write_data)
 {
 	switch (write_data->type) {
 	case BUFFER_WRITE_MD5:
-		buffer_md5_done(write_data);
+	case BUFFER_WRITE_SHA256:
+		buffer_hash_done(write_data);
 		break;
 	}
 	return 0;
@@ -125,7 +127,9 @@ buffer_write(struct buffer_data *data, const void *buf, off_t length,
 			ohshite(_("error in buffer_write(stream): %s"), desc);
 		break;
 	case BUFFER_WRITE_MD5:
-		MD5Update(&(((struct buffer_write_md5ctx *)data->arg.ptr)->ctx), buf, length);
+	case BUFFER_WRITE_SHA256:
+		hash_update(&((struct buffer_write_hashctx *)data->arg.ptr)->ctx,
+		            buf, length);
 		break;
 	default:
 		internerr("unknown data type '%i' in buffer_write",
@@ -196,6 +200,36 @@ buffer_copy_TYPE(IntPtr, int, i, void *, ptr);
 buffer_copy_TYPE(PtrInt, void *, ptr, int, i);
 buffer_copy_TYPE(PtrPtr, void *, ptr, void *, ptr);
 
+off_t
+fd_fd_copy_and_md5(int fd_in, int fd_out, char *hash, off_t limit,
+                   const char *desc, ...)
+{
+	va_list al;
+	struct buffer_data read_data, filter_data, write_data;
+	struct varbuf v = VARBUF_INIT;
+	off_t ret;
+
+	read_data.arg.i = fd_in;
+	read_data.type = BUFFER_READ_FD;
+	filter_data.arg.ptr = hash;
+	filter_data.type = BUFFER_WRITE_MD5;
+	write_data.arg.i = fd_out;
+	write_data.type = BUFFER_WRITE_FD;
+
+	va_start(al, desc);
+	varbufvprintf(&v, desc, al);
+	va_end(al);
+
+	buffer_init(&read_data, &filter_data);
+	ret = buffer_copy_filter(&read_data, &filter_data, &write_data,
+	                         limit, v.buf);
+	buffer_done(&read_data, &filter_data);
+
+	varbuffree(&v);
+
+	return ret;
+}
+
 off_t
 buffer_hash(const void *input, void *output, int type, off_t limit)
 {
@@ -209,12 +243,175 @@ buffer_hash(const void *input, void *output, int type, off_t limit)
 	return ret;
 }
 
+/* Size limits for the adaptive copy buffer. */
+#define BUFFER_COPY_MIN		(64 * 1024)
+#define BUFFER_COPY_MAX		(1024 * 1024)
+
+/* Largest chunk handed to the kernel in a single zero-copy call. */
+#define BUFFER_ZEROCOPY_CHUNK	(1024 * 1024 * 1024)
+
+static struct buffer_copy_stats copy_stats;
+
+void
+buffer_copy_get_stats(struct buffer_copy_stats *stats)
+{
+	*stats = copy_stats;
+}
+
+static void
+buffer_copy_account(struct timeval *start, off_t bytes, bool zerocopy)
+{
+	struct timeval end;
+
+	gettimeofday(&end, NULL);
+
+	copy_stats.copies++;
+	copy_stats.bytes += bytes;
+	if (zerocopy) {
+		copy_stats.zerocopy_copies++;
+		copy_stats.zerocopy_bytes += bytes;
+	}
+	copy_stats.seconds += (end.tv_sec - start->tv_sec) +
+	                      (end.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+static void *
+buffer_alloc(size_t size)
+{
+#ifdef HAVE_POSIX_MEMALIGN
+	void *buf;
+
+	if (posix_memalign(&buf, sysconf(_SC_PAGESIZE), size) == 0)
+		return buf;
+#endif
+
+	return m_malloc(size);
+}
+
+enum buffer_zerocopy_method {
+	zerocopy_none,
+	zerocopy_copy_file_range,
+	zerocopy_splice,
+	zerocopy_sendfile,
+};
+
+static enum buffer_zerocopy_method
+buffer_zerocopy_method(int fd_in, int fd_out)
+{
+	struct stat st_in, st_out;
+
+	if (fstat(fd_in, &st_in) < 0 || fstat(fd_out, &st_out) < 0)
+		return zerocopy_none;
+
+#ifdef HAVE_COPY_FILE_RANGE
+	if (S_ISREG(st_in.st_mode) && S_ISREG(st_out.st_mode))
+		return zerocopy_copy_file_range;
+#endif
+#ifdef HAVE_SPLICE
+	if (S_ISFIFO(st_in.st_mode) || S_ISFIFO(st_out.st_mode))
+		return zerocopy_splice;
+#endif
+#ifdef HAVE_SENDFILE
+	if (S_ISREG(st_in.st_mode))
+		return zerocopy_sendfile;
+#endif
+
+	return zerocopy_none;
+}
+
+/*
+ * Copy between two file descriptors without passing the data through
+ * user space. Returns -1 without having copied anything if the kernel
+ * cannot do it for these descriptors, so that the caller can fall back
+ * to a plain read and write loop.
+ */
+static off_t
+buffer_copy_zerocopy(int fd_in, int fd_out, off_t limit, const char *desc)
+{
+	enum buffer_zerocopy_method method;
+	off_t total = 0;
+	ssize_t r;
+	size_t len;
+
+	method = buffer_zerocopy_method(fd_in, fd_out);
+	if (method == zerocopy_none)
+		return -1;
+
+	while (limit != 0) {
+		len = BUFFER_ZEROCOPY_CHUNK;
+		if (limit != -1 && limit < (off_t)len)
+			len = limit;
+
+		switch (method) {
+#ifdef HAVE_COPY_FILE_RANGE
+		case zerocopy_copy_file_range:
+			r = copy_file_range(fd_in, NULL, fd_out, NULL, len, 0);
+			break;
+#endif
+#ifdef HAVE_SPLICE
+		case zerocopy_splice:
+			r = splice(fd_in, NULL, fd_out, NULL, len, SPLICE_F_MOVE);
+			break;
+#endif
+#ifdef HAVE_SENDFILE
+		case zerocopy_sendfile:
+			r = sendfile(fd_out, fd_in, NULL, len);
+			break;
+#endif
+		default:
+			internerr("unknown zero-copy method %d", method);
+		}
+
+		if (r < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			/* Not supported for this pair of descriptors. */
+			if (total == 0 &&
+			    (errno == EINVAL || errno == ENOSYS ||
+			     errno == EXDEV || errno == EBADF ||
+			     errno == EOPNOTSUPP))
+				return -1;
+			ohshite(_("failed in buffer_copy (%s)"), desc);
+		}
+		if (r == 0)
+			break;
+
+		total += r;
+		if (limit != -1)
+			limit -= r;
+	}
+
+	if (limit > 0)
+		ohshit(_("short read in buffer_copy (%s)"), desc);
+
+	return total;
+}
+
 off_t
 buffer_copy(struct buffer_data *read_data, struct buffer_data *write_data,
             off_t limit, const char *desc)
 {
+	return buffer_copy_filter(read_data, NULL, write_data, limit, desc);
+}
+
+/*
+ * Like buffer_copy, but also pass all data read through filter_data, if
+ * not NULL, which is typically used to compute a hash of the data while
+ * it streams by.
+ *
+ * When copying between two file descriptors without a filter, the data
+ * is moved by the kernel if possible. Otherwise it goes through a page
+ * aligned buffer, which grows while the reads keep filling it.
+ */
+off_t
+buffer_copy_filter(struct buffer_data *read_data,
+                   struct buffer_data *filter_data,
+                   struct buffer_data *write_data,
+                   off_t limit, const char *desc)
+{
+	struct timeval start;
 	char *buf, *writebuf;
-	int bufsize = 32768;
+	long bufsize = BUFFER_COPY_MIN;
 	long bytesread = 0, byteswritten = 0;
 	off_t totalread = 0, totalwritten = 0;
 
@@ -223,7 +420,20 @@ buffer_copy(struct buffer_data *read_data, struct buffer_data *write_data,
 	if (bufsize == 0)
 		return 0;
 
-	writebuf = buf = m_malloc(bufsize);
+	gettimeofday(&start, NULL);
+
+	if (!filter_data && read_data->type == BUFFER_READ_FD &&
+	    write_data->type == BUFFER_WRITE_FD) {
+		totalread = buffer_copy_zerocopy(read_data->arg.i,
+		                                 write_data->arg.i, limit, desc);
+		if (totalread >= 0) {
+			buffer_copy_account(&start, totalread, true);
+			return totalread;
+		}
+		totalread = 0;
+	}
+
+	writebuf = buf = buffer_alloc(bufsize);
 
 	while (bytesread >= 0 && byteswritten >= 0 && bufsize > 0) {
 		bytesread = buffer_read(read_data, buf, bufsize, desc);
@@ -236,11 +446,10 @@ buffer_copy(struct buffer_data *read_data, struct buffer_data *write_data,
 			break;
 
 		totalread += bytesread;
-		if (limit != -1) {
+		if (filter_data)
+			buffer_write(filter_data, buf, bytesread, desc);
+		if (limit != -1)
 			limit -= bytesread;
-			if (limit < bufsize)
-				bufsize = limit;
-		}
 		writebuf = buf;
 		while (bytesread) {
 			byteswritten = buffer_write(write_data, writebuf, bytesread, desc);
@@ -256,6 +465,18 @@ buffer_copy(struct buffer_data *read_data, struct buffer_data *write_data,
 			totalwritten += byteswritten;
 			writebuf += byteswritten;
 		}
+
+		/* Large transfers get a larger buffer, to cut down on the
+		 * number of system calls. */
+		if (bytesread == 0 && writebuf - buf == bufsize &&
+		    bufsize < BUFFER_COPY_MAX &&
+		    (limit == -1 || limit > bufsize)) {
+			free(buf);
+			bufsize *= 2;
+			buf = buffer_alloc(bufsize);
+		}
+		if (limit != -1 && limit < bufsize)
+			bufsize = limit;
 	}
 
 	if (bytesread < 0 || byteswritten < 0)
@@ -265,6 +486,7 @@ buffer_copy(struct buffer_data *read_data, struct buffer_data *write_data,
 
 	free(buf);
 
+	buffer_copy_account(&start, totalread, false);
+
 	return totalread;
 }
-
@@ -37,6 +37,7 @@ DPKG_BEGIN_DECLS
 #define BUFFER_WRITE_NULL		3
 #define BUFFER_WRITE_STREAM		4
 #define BUFFER_WRITE_MD5		5
+#define BUFFER_WRITE_SHA256		6
 
 #define BUFFER_READ_FD			0
 #define BUFFER_READ_STREAM		1
@@ -51,6 +52,8 @@ struct buffer_data {
 
 # define buffer_md5(buf, hash, limit) \
 	buffer_hash(buf, hash, BUFFER_WRITE_MD5, limit)
+# define buffer_sha256(buf, hash, limit) \
+	buffer_hash(buf, hash, BUFFER_WRITE_SHA256, limit)
 
 #if HAVE_C99
 # define fd_md5(fd, hash, limit, ...) \
@@ -59,6 +62,9 @@ struct buffer_data {
 # define stream_md5(file, hash, limit, ...) \
 	buffer_copy_PtrPtr(file, BUFFER_READ_STREAM, hash, BUFFER_WRITE_MD5, \
 	                   limit, __VA_ARGS__)
+# define fd_sha256(fd, hash, limit, ...) \
+	buffer_copy_IntPtr(fd, BUFFER_READ_FD, hash, BUFFER_WRITE_SHA256, \
+	                   limit, __VA_ARGS__)
 # define fd_fd_copy(fd1, fd2, limit, ...) \
 	buffer_copy_IntInt(fd1, BUFFER_READ_FD, fd2, BUFFER_WRITE_FD, \
 	                   limit, __VA_ARGS__)
@@ -94,6 +100,9 @@ struct buffer_data {
 # define stream_md5(file, hash, limit, desc...) \
 	buffer_copy_PtrPtr(file, BUFFER_READ_STREAM, hash, BUFFER_WRITE_MD5, \
 	                   limit, desc)
+# define fd_sha256(fd, hash, limit, desc...) \
+	buffer_copy_IntPtr(fd, BUFFER_READ_FD, hash, BUFFER_WRITE_SHA256, \
+	                   limit, desc)
 # define fd_fd_copy(fd1, fd2, limit, desc...) \
 	buffer_copy_IntInt(fd1, BUFFER_READ_FD, fd2, BUFFER_WRITE_FD, \
 	                   limit, desc)
@@ -136,6 +145,8 @@ off_t buffer_copy_IntPtr(int i, int typeIn, void *p, int typeOut,
 off_t buffer_copy_IntInt(int i1, int typeIn, int i2, int typeOut,
                          off_t limit, const char *desc,
                          ...) DPKG_ATTR_PRINTF(6);
+off_t fd_fd_copy_and_md5(int fd_in, int fd_out, char *hash, off_t limit,
+                         const char *desc, ...) DPKG_ATTR_PRINTF(5);
 off_t buffer_hash(const void *buf, void *hash, int typeOut, off_t length);
 
 off_t buffer_write(struct buffer_data *data, const void *buf,
@@ -149,6 +160,20 @@ off_t buffer_done(struct buffer_data *read_data,
 off_t buffer_copy(struct buffer_data *read_data,
                   struct buffer_data *write_data,
                   off_t limit, const char *desc);
+off_t buffer_copy_filter(struct buffer_data *read_data,
+                         struct buffer_data *filter_data,
+                         struct buffer_data *write_data,
+                         off_t limit, const char *desc);
+
+struct buffer_copy_stats {
+	unsigned long copies;
+	unsigned long zerocopy_copies;
+	off_t bytes;
+	off_t zerocopy_bytes;
+	double seconds;
+};
+
+void buffer_copy_get_stats(struct buffer_copy_stats *stats);
 
 DPKG_END_DECLS
 
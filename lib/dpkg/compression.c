@@ -19,6 +19,9 @@
 #include <dpkg/dpkg-db.h>
 #include <dpkg/buffer.h>
 
+/* Size of the buffers used to feed the compression libraries. */
+#define COMPRESS_BUFSIZE (64 * 1024)
+
 static void
 fd_fd_filter(int fd_in, int fd_out,
 	     const char *file, const char *cmd, const char *args,
@@ -48,7 +51,7 @@ void decompress_cat(enum compress_type type, int fd_in, int fd_out, char *desc,
     case compress_type_gzip:
 #ifdef WITH_ZLIB
       {
-        char buffer[4096];
+        static char buffer[COMPRESS_BUFSIZE];
         int actualread;
         gzFile gzfile = gzdopen(fd_in, "r");
         while ((actualread= gzread(gzfile,buffer,sizeof(buffer))) > 0) {
@@ -71,7 +74,7 @@ void decompress_cat(enum compress_type type, int fd_in, int fd_out, char *desc,
     case compress_type_bzip2:
 #ifdef WITH_BZ2
       {   
-        char buffer[4096];
+        static char buffer[COMPRESS_BUFSIZE];
         int actualread;
         BZFILE *bzfile = BZ2_bzdopen(fd_in, "r");
         while ((actualread= BZ2_bzread(bzfile,buffer,sizeof(buffer))) > 0) {
@@ -119,7 +122,7 @@ void compress_cat(enum compress_type type, int fd_in, int fd_out, const char *co
 #ifdef WITH_ZLIB
       {
         int actualread, actualwrite;
-        char buffer[4096];
+        static char buffer[COMPRESS_BUFSIZE];
         gzFile gzfile;
         strncpy(combuf, "w9", sizeof(combuf));
         combuf[1]= *compression;
@@ -154,7 +157,7 @@ void compress_cat(enum compress_type type, int fd_in, int fd_out, const char *co
 #ifdef WITH_BZ2
       {
         int actualread, actualwrite;
-        char buffer[4096];
+        static char buffer[COMPRESS_BUFSIZE];
         BZFILE *bzfile;
         strncpy(combuf, "w9", sizeof(combuf));
         combuf[1]= *compression;
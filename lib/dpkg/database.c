@@ -183,6 +183,7 @@ void iterpkgend(struct pkgiterator *i) {
 void resetpackages(void) {
   int i;
   nffreeall();
+  trig_activation_forget();
   npackages= 0;
   for (i=0; i<BINS; i++) bins[i]= NULL;
 }
@@ -41,6 +41,7 @@
 
 #include <dpkg/dpkg.h>
 #include <dpkg/dpkg-db.h>
+#include <dpkg/ioacct.h>
 
 char *statusfile=NULL, *availablefile=NULL;
 char *triggersdir, *triggersfilefile, *triggersnewfilefile;
@@ -89,10 +90,11 @@ static void cleanupdates(void) {
     }
 
     if (cstatus >= msdbrw_write) {
-      writedb(statusfile,0,1);
+      writedb(statusfile, 0, !(cflags & msdbrw_unsafe_io));
     
       for (i=0; i<cdn; i++) {
         strcpy(updatefnrest, cdlist[i]->d_name);
+        ioacct_count(ioacct_unlink);
         if (unlink(updatefnbuf))
           ohshite(_("failed to remove incorporated update file %.255s"),updatefnbuf);
         free(cdlist[i]);
@@ -110,6 +112,7 @@ static void createimptmp(void) {
   
   onerr_abort++;
   
+  ioacct_count(ioacct_open);
   importanttmp= fopen(importanttmpfile,"w");
   if (!importanttmp)
     ohshite(_("unable to create `%.255s'"), importanttmpfile);
@@ -141,7 +144,10 @@ static const struct fni {
 
 enum modstatdb_rw modstatdb_init(const char *adir, enum modstatdb_rw readwritereq) {
   const struct fni *fnip;
+  struct timespan span;
   
+  timespan_start(&span, "modstatdb_init", NULL);
+
   admindir= adir;
 
   for (fnip=fnis; fnip->suffix; fnip++) {
@@ -200,18 +206,30 @@ enum modstatdb_rw modstatdb_init(const char *adir, enum modstatdb_rw readwritere
   trig_fixup_awaiters(cstatus);
   trig_incorporate(cstatus, admindir);
 
+  timespan_end(&span);
+
   return cstatus;
 }
 
+/* Whether the database should be written without syncing to disk, which
+ * also applies to other files tied to it, like the packages file lists.
+ */
+bool
+modstatdb_is_unsafe_io(void)
+{
+  return cflags & msdbrw_unsafe_io;
+}
+
 void modstatdb_checkpoint(void) {
   int i;
 
   assert(cstatus >= msdbrw_write);
-  writedb(statusfile,0,1);
+  writedb(statusfile, 0, !(cflags & msdbrw_unsafe_io));
   
   for (i=0; i<nextupdate; i++) {
     sprintf(updatefnrest, IMPORTANTFMT, i);
     assert(strlen(updatefnrest)<=IMPORTANTMAXLEN); /* or we've made a real mess */
+    ioacct_count(ioacct_unlink);
     if (unlink(updatefnbuf))
       ohshite(_("failed to remove my own update file %.255s"),updatefnbuf);
   }
@@ -226,6 +244,7 @@ void modstatdb_shutdown(void) {
     writedb(availablefile,1,0);
     /* tidy up a bit, but don't worry too much about failure */
     fclose(importanttmp);
+    ioacct_count(ioacct_unlink);
     unlink(importanttmpfile);
     varbuffree(&uvb);
     /* fall through */
@@ -254,13 +273,19 @@ modstatdb_note_core(struct pkginfo *pkg)
     ohshite(_("unable to write updated status of `%.250s'"), pkg->name);
   if (fflush(importanttmp))
     ohshite(_("unable to flush updated status of `%.250s'"), pkg->name);
+  ioacct_written(uvb.used);
+  ioacct_count(ioacct_other);
   if (ftruncate(fileno(importanttmp), uvb.used))
     ohshite(_("unable to truncate for updated status of `%.250s'"), pkg->name);
-  if (fsync(fileno(importanttmp)))
-    ohshite(_("unable to fsync updated status of `%.250s'"), pkg->name);
+  if (!(cflags & msdbrw_unsafe_io)) {
+    ioacct_count(ioacct_fsync);
+    if (fsync(fileno(importanttmp)))
+      ohshite(_("unable to fsync updated status of `%.250s'"), pkg->name);
+  }
   if (fclose(importanttmp))
     ohshite(_("unable to close updated status of `%.250s'"), pkg->name);
   sprintf(updatefnrest, IMPORTANTFMT, nextupdate);
+  ioacct_count(ioacct_rename);
   if (rename(importanttmpfile, updatefnbuf))
     ohshite(_("unable to install updated status of `%.250s'"), pkg->name);
 
@@ -292,13 +317,16 @@ void modstatdb_note(struct pkginfo *pkg) {
    * to interesting (for triggers) values has to care about triggers.
    */
   if (pkg->status != stat_triggerspending &&
-      pkg->status != stat_triggersawaited)
+      pkg->status != stat_triggersawaited && pkg->trigpend_head) {
     pkg->trigpend_head = NULL;
+    trig_activation_forget();
+  }
 
-  if (pkg->status <= stat_configfiles) {
+  if (pkg->status <= stat_configfiles && pkg->trigaw.head) {
     for (ta = pkg->trigaw.head; ta; ta = ta->sameaw.next)
       ta->aw = NULL;
     pkg->trigaw.head = pkg->trigaw.tail = NULL;
+    trig_activation_forget();
   }
 
   log_message("status %s %s %s", statusinfos[pkg->status].name, pkg->name,
@@ -204,10 +204,12 @@ enum modstatdb_rw {
   msdbrw_flagsmask= ~077,
   /* flags start at 0100 */
   msdbrw_noavail= 0100,
+  msdbrw_unsafe_io= 0200,
 };
 
 enum modstatdb_rw modstatdb_init(const char *admindir, enum modstatdb_rw reqrwflags);
 void modstatdb_note(struct pkginfo *pkg);
+bool modstatdb_is_unsafe_io(void);
 void modstatdb_note_ifwrite(struct pkginfo *pkg);
 void modstatdb_checkpoint(void);
 void modstatdb_shutdown(void);
@@ -294,6 +296,20 @@ extern struct trig_hooks trigh;
 void trig_file_activate_byname(const char *trig, struct pkginfo *aw);
 void trig_file_activate(struct filenamenode *trig, struct pkginfo *aw);
 
+/* Calls cb for every file trigger interest in path or in any of its
+ * parent directories. */
+typedef void trig_file_interest_cb(struct trigfileint *tfi, void *user);
+void trig_file_interests_match(const char *path, trig_file_interest_cb *cb,
+                               void *user);
+
+struct trig_activation_stats {
+  unsigned long seen;
+  unsigned long recorded;
+};
+
+void trig_activation_forget(void);
+void trig_activation_get_stats(struct trig_activation_stats *stats);
+
 int trig_note_pend_core(struct pkginfo *pend, const char *trig /*not copied!*/);
 int trig_note_pend(struct pkginfo *pend, const char *trig /*not copied!*/);
 int trig_note_aw(struct pkginfo *pend, struct pkginfo *aw);
@@ -31,6 +31,7 @@ DPKG_BEGIN_DECLS
 #include <stdarg.h>
 #include <stdio.h>
 #include <sys/types.h>
+#include <sys/time.h>
 
 #ifdef HAVE_SYS_CDEFS_H
 #include <sys/cdefs.h>
@@ -181,6 +182,19 @@ extern struct pipef *status_pipes;
 
 void statusfd_send(const char *fmt, ...);
 
+/* Set to emit timing spans. */
+extern int log_timing;
+
+struct timespan {
+  const char *phase;
+  const char *subject;
+  struct timeval start;
+};
+
+void timespan_start(struct timespan *ts, const char *phase,
+                    const char *subject);
+void timespan_end(struct timespan *ts);
+
 /*** cleanup.c ***/
 
 void cu_closefile(int argc, void **argv);
@@ -362,9 +362,11 @@ void writedb(const char *filename, int available, int mustsync) {
   const char *which;
   FILE *file;
   struct varbuf vb = VARBUF_INIT;
+  struct timespan span;
   int old_umask;
 
   which= available ? "available" : "status";
+  timespan_start(&span, "writedb", which);
   oldfn= m_malloc(strlen(filename)+sizeof(OLDDBEXT));
   strcpy(oldfn,filename); strcat(oldfn,OLDDBEXT);
   newfn= m_malloc(strlen(filename)+sizeof(NEWDBEXT));
@@ -410,4 +412,6 @@ void writedb(const char *filename, int available, int mustsync) {
             newfn, filename, which);
   free(newfn);
   free(oldfn);
+
+  timespan_end(&span);
 }
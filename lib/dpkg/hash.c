@@ -0,0 +1,117 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * hash.c - message digest streaming interface
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with dpkg; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <config.h>
+#include <compat.h>
+
+#include <limits.h>
+
+#include <dpkg/dpkg.h>
+#include <dpkg/hash.h>
+
+void
+hash_init(struct hash_context *ctx, enum hash_type type)
+{
+	ctx->type = type;
+
+	switch (type) {
+	case HASH_MD5:
+		MD5Init(&ctx->u.md5);
+		break;
+	case HASH_SHA256:
+		SHA256Init(&ctx->u.sha256);
+		break;
+	}
+}
+
+void
+hash_update(struct hash_context *ctx, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+
+	switch (ctx->type) {
+	case HASH_MD5:
+		/* MD5Update only takes an unsigned length. */
+		while (len > UINT_MAX) {
+			MD5Update(&ctx->u.md5, p, UINT_MAX & ~63U);
+			p += UINT_MAX & ~63U;
+			len -= UINT_MAX & ~63U;
+		}
+		MD5Update(&ctx->u.md5, p, len);
+		break;
+	case HASH_SHA256:
+		SHA256Update(&ctx->u.sha256, p, len);
+		break;
+	}
+}
+
+/*
+ * Finish the digest and store it as a lowercase hex string in hex,
+ * which needs to be at least hash_hexlen() + 1 characters long.
+ */
+void
+hash_final(struct hash_context *ctx, char *hex)
+{
+	static const char hexdigits[] = "0123456789abcdef";
+	unsigned char digest[32];
+	size_t i, len = 0;
+
+	switch (ctx->type) {
+	case HASH_MD5:
+		MD5Final(digest, &ctx->u.md5);
+		len = 16;
+		break;
+	case HASH_SHA256:
+		SHA256Final(digest, &ctx->u.sha256);
+		len = 32;
+		break;
+	}
+
+	for (i = 0; i < len; i++) {
+		*hex++ = hexdigits[digest[i] >> 4];
+		*hex++ = hexdigits[digest[i] & 0xf];
+	}
+	*hex = '\0';
+}
+
+size_t
+hash_hexlen(enum hash_type type)
+{
+	switch (type) {
+	case HASH_MD5:
+		return MD5HASHLEN;
+	case HASH_SHA256:
+		return SHA256HASHLEN;
+	}
+
+	return 0;
+}
+
+const char *
+hash_impl_name(enum hash_type type)
+{
+	switch (type) {
+	case HASH_MD5:
+		return "generic";
+	case HASH_SHA256:
+		return sha256_impl_name();
+	}
+
+	return NULL;
+}
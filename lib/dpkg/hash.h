@@ -0,0 +1,55 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * hash.h - message digest streaming interface
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with dpkg; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef DPKG_HASH_H
+#define DPKG_HASH_H
+
+#include <stddef.h>
+
+#include <dpkg/macros.h>
+#include <dpkg/md5.h>
+#include <dpkg/sha256.h>
+
+DPKG_BEGIN_DECLS
+
+#define SHA256HASHLEN 64
+
+enum hash_type {
+	HASH_MD5,
+	HASH_SHA256,
+};
+
+struct hash_context {
+	enum hash_type type;
+	union {
+		struct MD5Context md5;
+		struct SHA256Context sha256;
+	} u;
+};
+
+void hash_init(struct hash_context *ctx, enum hash_type type);
+void hash_update(struct hash_context *ctx, const void *buf, size_t len);
+void hash_final(struct hash_context *ctx, char *hex);
+
+size_t hash_hexlen(enum hash_type type);
+const char *hash_impl_name(enum hash_type type);
+
+DPKG_END_DECLS
+
+#endif /* DPKG_HASH_H */
@@ -0,0 +1,130 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * ioacct.c - per package accounting of file system calls
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with dpkg; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <config.h>
+#include <compat.h>
+
+#include <string.h>
+
+#include <dpkg/dpkg.h>
+#include <dpkg/ioacct.h>
+
+#define IOACCT_BINS	251
+
+struct ioacct_node {
+	struct ioacct acct;
+	/* In the order the subjects were first seen. */
+	struct ioacct_node *next;
+	struct ioacct_node *hashnext;
+};
+
+static struct ioacct_node ioacct_none = { { "-" } };
+static struct ioacct_node *ioacct_bins[IOACCT_BINS];
+static struct ioacct_node **ioacct_tail = &ioacct_none.next;
+static struct ioacct_node *ioacct_current = &ioacct_none;
+
+static const char *const ioacct_op_names[] = {
+	[ioacct_open] = "open",
+	[ioacct_stat] = "stat",
+	[ioacct_rename] = "rename",
+	[ioacct_unlink] = "unlink",
+	[ioacct_fsync] = "fsync",
+	[ioacct_other] = "other",
+};
+
+static unsigned int
+ioacct_hash(const char *name)
+{
+	unsigned int h = 0;
+
+	while (*name)
+		h = h * 33 + (unsigned char)*name++;
+
+	return h % IOACCT_BINS;
+}
+
+/*
+ * Charge the calls that follow to the package named subject, or to
+ * nobody if it is NULL, and return the previous subject so it can be
+ * restored. The name has to stay valid until the counters have been
+ * reported.
+ */
+const char *
+ioacct_subject(const char *subject)
+{
+	struct ioacct_node *node;
+	const char *prev;
+	unsigned int h;
+
+	prev = ioacct_current == &ioacct_none ? NULL : ioacct_current->acct.subject;
+
+	if (!subject) {
+		ioacct_current = &ioacct_none;
+		return prev;
+	}
+	if (ioacct_current->acct.subject == subject)
+		return prev;
+
+	h = ioacct_hash(subject);
+	for (node = ioacct_bins[h]; node; node = node->hashnext)
+		if (strcmp(node->acct.subject, subject) == 0)
+			break;
+
+	if (!node) {
+		node = m_malloc(sizeof(*node));
+		memset(node, 0, sizeof(*node));
+		node->acct.subject = subject;
+		node->hashnext = ioacct_bins[h];
+		ioacct_bins[h] = node;
+		*ioacct_tail = node;
+		ioacct_tail = &node->next;
+	}
+
+	ioacct_current = node;
+
+	return prev;
+}
+
+/* Only to be called from the main thread. */
+void
+ioacct_count(enum ioacct_op op)
+{
+	ioacct_current->acct.ops[op]++;
+}
+
+void
+ioacct_written(off_t bytes)
+{
+	ioacct_current->acct.written += bytes;
+}
+
+const char *
+ioacct_op_name(enum ioacct_op op)
+{
+	return ioacct_op_names[op];
+}
+
+void
+ioacct_foreach(void (*fn)(const struct ioacct *acct, void *data), void *data)
+{
+	struct ioacct_node *node;
+
+	for (node = &ioacct_none; node; node = node->next)
+		fn(&node->acct, data);
+}
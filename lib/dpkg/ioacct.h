@@ -0,0 +1,56 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * ioacct.h - per package accounting of file system calls
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with dpkg; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef DPKG_IOACCT_H
+#define DPKG_IOACCT_H
+
+#include <sys/types.h>
+
+#include <dpkg/macros.h>
+
+DPKG_BEGIN_DECLS
+
+enum ioacct_op {
+	ioacct_open,
+	ioacct_stat,
+	ioacct_rename,
+	ioacct_unlink,
+	ioacct_fsync,
+	ioacct_other,
+	ioacct_op_count
+};
+
+struct ioacct {
+	/* Package name, or "-" for work not done on behalf of a package. */
+	const char *subject;
+	unsigned long ops[ioacct_op_count];
+	off_t written;
+};
+
+const char *ioacct_subject(const char *subject);
+void ioacct_count(enum ioacct_op op);
+void ioacct_written(off_t bytes);
+
+const char *ioacct_op_name(enum ioacct_op op);
+void ioacct_foreach(void (*fn)(const struct ioacct *acct, void *data),
+                    void *data);
+
+DPKG_END_DECLS
+
+#endif /* DPKG_IOACCT_H */
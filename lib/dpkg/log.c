@@ -24,6 +24,8 @@
 
 #include <dpkg/i18n.h>
 
+#include <sys/time.h>
+
 #include <assert.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -106,3 +108,42 @@ statusfd_send(const char *fmt, ...)
 	}
 }
 
+
+int log_timing = 0;
+
+/*
+ * Timing spans are emitted, when asked for, as one line each on the
+ * status-fd and in the log, so that they can be aggregated by tools:
+ *
+ *   timing: <phase> : <subject> : <seconds>
+ *   YYYY-MM-DD HH:MM:SS timing <phase> <subject> <seconds>
+ *
+ * The subject is usually a package name, or "-" when there is none. A
+ * span left unfinished because of an error is not emitted.
+ */
+void
+timespan_start(struct timespan *ts, const char *phase, const char *subject)
+{
+	ts->phase = phase;
+	ts->subject = subject ? subject : "-";
+	if (log_timing)
+		gettimeofday(&ts->start, NULL);
+}
+
+void
+timespan_end(struct timespan *ts)
+{
+	struct timeval end;
+	double elapsed;
+
+	if (!log_timing)
+		return;
+
+	gettimeofday(&end, NULL);
+	elapsed = (end.tv_sec - ts->start.tv_sec) +
+	          (end.tv_usec - ts->start.tv_usec) / 1000000.0;
+
+	log_message("timing %s %s %.6f", ts->phase, ts->subject, elapsed);
+	statusfd_send("timing: %s : %s : %.6f", ts->phase, ts->subject,
+	              elapsed);
+}
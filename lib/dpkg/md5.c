@@ -88,6 +88,17 @@ MD5Update(struct MD5Context *ctx, md5byte const *buf, unsigned len)
 	len -= t;
 
 	/* Process data in 64-byte chunks */
+#ifndef WORDS_BIGENDIAN
+	/* No byte swapping needed, so avoid copying the data around when
+	 * the input is suitably aligned to be used in place. */
+	if (((unsigned long)buf & (sizeof(UWORD32) - 1)) == 0) {
+		while (len >= 64) {
+			MD5Transform(ctx->buf, (UWORD32 const *)buf);
+			buf += 64;
+			len -= 64;
+		}
+	}
+#endif
 	while (len >= 64) {
 		memcpy(ctx->in, buf, 64);
 		byteSwap(ctx->in, 16);
@@ -0,0 +1,400 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * sha256.c - SHA-256 message digest
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with dpkg; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <config.h>
+#include <compat.h>
+
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef HAVE_X86_SHA_INTRINSICS
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+#ifdef HAVE_ARM_SHA2_INTRINSICS
+#include <sys/auxv.h>
+#include <arm_neon.h>
+#ifndef HWCAP_SHA2
+#define HWCAP_SHA2 (1 << 6)
+#endif
+#endif
+
+#include <dpkg/sha256.h>
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROR32(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+#define CH(x, y, z)	((z) ^ ((x) & ((y) ^ (z))))
+#define MAJ(x, y, z)	(((x) & (y)) | ((z) & ((x) | (y))))
+#define SIGMA0(x)	(ROR32(x, 2) ^ ROR32(x, 13) ^ ROR32(x, 22))
+#define SIGMA1(x)	(ROR32(x, 6) ^ ROR32(x, 11) ^ ROR32(x, 25))
+#define GAMMA0(x)	(ROR32(x, 7) ^ ROR32(x, 18) ^ ((x) >> 3))
+#define GAMMA1(x)	(ROR32(x, 17) ^ ROR32(x, 19) ^ ((x) >> 10))
+
+static inline uint32_t
+load_be32(const unsigned char *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+	       (uint32_t)p[2] << 8 | (uint32_t)p[3];
+}
+
+static inline void
+store_be32(unsigned char *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static void
+sha256_transform_generic(uint32_t state[8], const unsigned char *data,
+                         size_t nblocks)
+{
+	uint32_t w[64];
+	uint32_t a, b, c, d, e, f, g, h, t1, t2;
+	int i;
+
+	while (nblocks--) {
+		for (i = 0; i < 16; i++)
+			w[i] = load_be32(data + i * 4);
+		for (i = 16; i < 64; i++)
+			w[i] = GAMMA1(w[i - 2]) + w[i - 7] +
+			       GAMMA0(w[i - 15]) + w[i - 16];
+
+		a = state[0];
+		b = state[1];
+		c = state[2];
+		d = state[3];
+		e = state[4];
+		f = state[5];
+		g = state[6];
+		h = state[7];
+
+		for (i = 0; i < 64; i++) {
+			t1 = h + SIGMA1(e) + CH(e, f, g) + sha256_k[i] + w[i];
+			t2 = SIGMA0(a) + MAJ(a, b, c);
+			h = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = b;
+			b = a;
+			a = t1 + t2;
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+		state[5] += f;
+		state[6] += g;
+		state[7] += h;
+
+		data += 64;
+	}
+}
+
+#ifdef HAVE_X86_SHA_INTRINSICS
+/*
+ * Intel SHA extensions. The state is kept in the ABEF/CDGH layout the
+ * sha256rnds2 instruction wants while processing the blocks.
+ */
+static void __attribute__((target("sha,sse4.1,ssse3")))
+sha256_transform_x86_sha(uint32_t state[8], const unsigned char *data,
+                         size_t nblocks)
+{
+	const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+	                                     0x0405060700010203ULL);
+	__m128i state0, state1, abef_save, cdgh_save, msg, tmp;
+	__m128i w[16];
+	int i;
+
+	tmp = _mm_loadu_si128((const __m128i *)&state[0]);
+	state1 = _mm_loadu_si128((const __m128i *)&state[4]);
+	tmp = _mm_shuffle_epi32(tmp, 0xb1);		/* CDAB */
+	state1 = _mm_shuffle_epi32(state1, 0x1b);	/* EFGH */
+	state0 = _mm_alignr_epi8(tmp, state1, 8);	/* ABEF */
+	state1 = _mm_blend_epi16(state1, tmp, 0xf0);	/* CDGH */
+
+	while (nblocks--) {
+		abef_save = state0;
+		cdgh_save = state1;
+
+		for (i = 0; i < 16; i++) {
+			if (i < 4) {
+				msg = _mm_loadu_si128((const __m128i *)(data + i * 16));
+				w[i] = _mm_shuffle_epi8(msg, bswap);
+			} else {
+				tmp = _mm_sha256msg1_epu32(w[i - 4], w[i - 3]);
+				tmp = _mm_add_epi32(tmp, _mm_alignr_epi8(w[i - 1],
+				                                         w[i - 2], 4));
+				w[i] = _mm_sha256msg2_epu32(tmp, w[i - 1]);
+			}
+
+			msg = _mm_add_epi32(w[i],
+			        _mm_loadu_si128((const __m128i *)&sha256_k[i * 4]));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+			msg = _mm_shuffle_epi32(msg, 0x0e);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+		}
+
+		state0 = _mm_add_epi32(state0, abef_save);
+		state1 = _mm_add_epi32(state1, cdgh_save);
+
+		data += 64;
+	}
+
+	tmp = _mm_shuffle_epi32(state0, 0x1b);		/* FEBA */
+	state1 = _mm_shuffle_epi32(state1, 0xb1);	/* DCHG */
+	state0 = _mm_blend_epi16(tmp, state1, 0xf0);	/* DCBA */
+	state1 = _mm_alignr_epi8(state1, tmp, 8);	/* HGFE */
+
+	_mm_storeu_si128((__m128i *)&state[0], state0);
+	_mm_storeu_si128((__m128i *)&state[4], state1);
+}
+
+static int
+sha256_have_x86_sha(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	if (!(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1))
+		return 0;
+	if (__get_cpuid_max(0, NULL) < 7)
+		return 0;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+
+	return (ebx & (1 << 29)) != 0;
+}
+#endif
+
+#ifdef HAVE_ARM_SHA2_INTRINSICS
+/*
+ * ARMv8 cryptography extensions.
+ */
+static void __attribute__((target("+crypto")))
+sha256_transform_arm_sha2(uint32_t state[8], const unsigned char *data,
+                          size_t nblocks)
+{
+	uint32x4_t state0, state1, abcd_save, efgh_save, msg, tmp;
+	uint32x4_t w[16];
+	int i;
+
+	state0 = vld1q_u32(&state[0]);
+	state1 = vld1q_u32(&state[4]);
+
+	while (nblocks--) {
+		abcd_save = state0;
+		efgh_save = state1;
+
+		for (i = 0; i < 16; i++) {
+			if (i < 4)
+				w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + i * 16)));
+			else
+				w[i] = vsha256su1q_u32(vsha256su0q_u32(w[i - 4], w[i - 3]),
+				                       w[i - 2], w[i - 1]);
+
+			msg = vaddq_u32(w[i], vld1q_u32(&sha256_k[i * 4]));
+			tmp = state0;
+			state0 = vsha256hq_u32(state0, state1, msg);
+			state1 = vsha256h2q_u32(state1, tmp, msg);
+		}
+
+		state0 = vaddq_u32(state0, abcd_save);
+		state1 = vaddq_u32(state1, efgh_save);
+
+		data += 64;
+	}
+
+	vst1q_u32(&state[0], state0);
+	vst1q_u32(&state[4], state1);
+}
+
+static int
+sha256_have_arm_sha2(void)
+{
+	return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+}
+#endif
+
+typedef void sha256_transform_func(uint32_t state[8],
+                                   const unsigned char *data, size_t nblocks);
+
+static sha256_transform_func *sha256_transform;
+static const char *sha256_transform_name;
+
+/*
+ * Pick the fastest block function the CPU we are running on supports.
+ */
+static void
+sha256_select(void)
+{
+	if (sha256_transform)
+		return;
+
+#ifdef HAVE_X86_SHA_INTRINSICS
+	if (sha256_have_x86_sha()) {
+		sha256_transform_name = "x86-sha";
+		sha256_transform = sha256_transform_x86_sha;
+		return;
+	}
+#endif
+#ifdef HAVE_ARM_SHA2_INTRINSICS
+	if (sha256_have_arm_sha2()) {
+		sha256_transform_name = "armv8-sha2";
+		sha256_transform = sha256_transform_arm_sha2;
+		return;
+	}
+#endif
+	sha256_transform_name = "generic";
+	sha256_transform = sha256_transform_generic;
+}
+
+const char *
+sha256_impl_name(void)
+{
+	sha256_select();
+
+	return sha256_transform_name;
+}
+
+/*
+ * Force a specific block function, for testing and benchmarking. Returns
+ * false if name is unknown or not supported by this CPU.
+ */
+bool
+sha256_set_impl(const char *name)
+{
+	if (strcmp(name, "generic") == 0) {
+		sha256_transform_name = "generic";
+		sha256_transform = sha256_transform_generic;
+		return true;
+	}
+#ifdef HAVE_X86_SHA_INTRINSICS
+	if (strcmp(name, "x86-sha") == 0 && sha256_have_x86_sha()) {
+		sha256_transform_name = "x86-sha";
+		sha256_transform = sha256_transform_x86_sha;
+		return true;
+	}
+#endif
+#ifdef HAVE_ARM_SHA2_INTRINSICS
+	if (strcmp(name, "armv8-sha2") == 0 && sha256_have_arm_sha2()) {
+		sha256_transform_name = "armv8-sha2";
+		sha256_transform = sha256_transform_arm_sha2;
+		return true;
+	}
+#endif
+
+	return false;
+}
+
+void
+SHA256Init(struct SHA256Context *ctx)
+{
+	sha256_select();
+
+	ctx->state[0] = 0x6a09e667;
+	ctx->state[1] = 0xbb67ae85;
+	ctx->state[2] = 0x3c6ef372;
+	ctx->state[3] = 0xa54ff53a;
+	ctx->state[4] = 0x510e527f;
+	ctx->state[5] = 0x9b05688c;
+	ctx->state[6] = 0x1f83d9ab;
+	ctx->state[7] = 0x5be0cd19;
+	ctx->bytes = 0;
+}
+
+void
+SHA256Update(struct SHA256Context *ctx, const unsigned char *buf, size_t len)
+{
+	size_t used = ctx->bytes & 0x3f;
+	size_t nblocks;
+
+	ctx->bytes += len;
+
+	if (used) {
+		size_t avail = 64 - used;
+
+		if (len < avail) {
+			memcpy(ctx->in + used, buf, len);
+			return;
+		}
+		memcpy(ctx->in + used, buf, avail);
+		sha256_transform(ctx->state, ctx->in, 1);
+		buf += avail;
+		len -= avail;
+	}
+
+	/* Hash the whole blocks straight from the caller's buffer. */
+	nblocks = len / 64;
+	if (nblocks) {
+		sha256_transform(ctx->state, buf, nblocks);
+		buf += nblocks * 64;
+		len -= nblocks * 64;
+	}
+
+	memcpy(ctx->in, buf, len);
+}
+
+void
+SHA256Final(unsigned char digest[32], struct SHA256Context *ctx)
+{
+	size_t used = ctx->bytes & 0x3f;
+	uint64_t bits = ctx->bytes << 3;
+	int i;
+
+	ctx->in[used++] = 0x80;
+	if (used > 56) {
+		memset(ctx->in + used, 0, 64 - used);
+		sha256_transform(ctx->state, ctx->in, 1);
+		used = 0;
+	}
+	memset(ctx->in + used, 0, 56 - used);
+	store_be32(ctx->in + 56, bits >> 32);
+	store_be32(ctx->in + 60, bits);
+	sha256_transform(ctx->state, ctx->in, 1);
+
+	for (i = 0; i < 8; i++)
+		store_be32(digest + i * 4, ctx->state[i]);
+
+	memset(ctx, 0, sizeof(*ctx));
+}
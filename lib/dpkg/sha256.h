@@ -0,0 +1,47 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * sha256.h - SHA-256 message digest
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with dpkg; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef DPKG_SHA256_H
+#define DPKG_SHA256_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <dpkg/macros.h>
+
+DPKG_BEGIN_DECLS
+
+struct SHA256Context {
+	uint32_t state[8];
+	uint64_t bytes;
+	unsigned char in[64];
+};
+
+void SHA256Init(struct SHA256Context *ctx);
+void SHA256Update(struct SHA256Context *ctx, const unsigned char *buf,
+                  size_t len);
+void SHA256Final(unsigned char digest[32], struct SHA256Context *ctx);
+
+const char *sha256_impl_name(void);
+bool sha256_set_impl(const char *name);
+
+DPKG_END_DECLS
+
+#endif /* DPKG_SHA256_H */
@@ -25,11 +25,15 @@
 #include <dpkg/i18n.h>
 
 #include <sys/types.h>
+#include <sys/time.h>
 #include <sys/wait.h>
+#include <assert.h>
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <signal.h>
+#include <unistd.h>
 
 #include <dpkg/dpkg.h>
 #include <dpkg/subproc.h>
@@ -125,3 +129,116 @@ waitsubproc(pid_t pid, const char *description, int flags)
 	return checksubprocerr(status, description, flags);
 }
 
+
+static struct subproc_spawn_stats spawn_stats;
+
+static void DPKG_ATTR_NORET
+spawn_child(const char *desc, const char *file, const char *const argv[],
+            const struct subproc_spawn *sp, const sigset_t *oldmask,
+            volatile int *child_errno)
+{
+	int i;
+
+	for (i = 0; i < 3; i++)
+		if (sp->fd[i] >= 0 && sp->fd[i] != i && dup2(sp->fd[i], i) < 0)
+			goto fail;
+	for (i = 0; i < 3; i++)
+		if (sp->fd[i] > 2)
+			close(sp->fd[i]);
+	if (sp->root && (chroot(sp->root) || chdir("/")))
+		goto fail;
+	if (sp->setup)
+		sp->setup(sp->data);
+	sigprocmask(SIG_SETMASK, oldmask, NULL);
+
+	if (sp->envp)
+		execve(file, (char *const *)argv, sp->envp);
+	else
+		execvp(file, (char *const *)argv);
+
+fail:
+	*child_errno = errno;
+#ifndef HAVE_VFORK
+	/* We have our own copy of everything, so we can say it ourselves. */
+	fprintf(stderr, _("%s (subprocess): unable to execute %s (%s): %s\n"),
+	        thisname, desc, file, strerror(errno));
+#endif
+	_exit(2);
+}
+
+static pid_t
+spawn(const char *desc, const char *file, const char *const argv[],
+      const struct subproc_spawn *sp)
+{
+	volatile int child_errno = 0;
+	struct timeval start, end;
+	sigset_t allsigs, oldmask;
+	pid_t pid;
+
+	/* No signal handler may run in the child while it uses our memory. */
+	sigfillset(&allsigs);
+	sigprocmask(SIG_SETMASK, &allsigs, &oldmask);
+
+	gettimeofday(&start, NULL);
+#ifdef HAVE_VFORK
+	pid = vfork();
+#else
+	pid = fork();
+#endif
+	if (pid == 0)
+		spawn_child(desc, file, argv, sp, &oldmask, &child_errno);
+	gettimeofday(&end, NULL);
+
+	sigprocmask(SIG_SETMASK, &oldmask, NULL);
+
+	if (pid == -1) {
+		if (sp->nonfatal)
+			return -1;
+		onerr_abort++;
+		ohshite(_("fork failed"));
+	}
+
+	spawn_stats.spawns++;
+	spawn_stats.last_usecs = (end.tv_sec - start.tv_sec) * 1000000 +
+	                         (end.tv_usec - start.tv_usec);
+	spawn_stats.total_usecs += spawn_stats.last_usecs;
+
+#ifdef HAVE_VFORK
+	if (child_errno)
+		fprintf(stderr,
+		        _("%s (subprocess): unable to execute %s (%s): %s\n"),
+		        thisname, desc, file, strerror(child_errno));
+#endif
+
+	return pid;
+}
+
+/*
+ * Start file with argv, looking it up in PATH unless it contains a slash.
+ *
+ * Unlike m_fork followed by exec, this does not need to copy our address
+ * space, which is large by the time the databases have been loaded; the
+ * child borrows it until the program is running. A program that cannot
+ * be run is reported on stderr and gives an exit status of 2, the same
+ * way as from a forked child, so that the caller handles it when waiting.
+ */
+pid_t
+subproc_spawn(const char *desc, const char *file, const char *const argv[],
+              const struct subproc_spawn *sp)
+{
+	static const struct subproc_spawn spawn_default = SUBPROC_SPAWN_INIT;
+
+	/* The defaults are resolved here, as no argument of the function
+	 * doing the vfork may be assigned to. */
+	if (!sp)
+		sp = &spawn_default;
+	assert(!sp->envp || strchr(file, '/'));
+
+	return spawn(desc, file, argv, sp);
+}
+
+void
+subproc_spawn_get_stats(struct subproc_spawn_stats *stats)
+{
+	*stats = spawn_stats;
+}
@@ -24,6 +24,8 @@
 
 #include <sys/types.h>
 
+#include <stdbool.h>
+
 #include <dpkg/macros.h>
 
 DPKG_BEGIN_DECLS
@@ -38,6 +40,39 @@ void cu_subproc_signals(int argc, void **argv);
 int checksubprocerr(int status, const char *desc, int flags);
 int waitsubproc(pid_t pid, const char *desc, int flags);
 
+struct subproc_spawn {
+	/* Descriptors to install as the child's standard input, output and
+	 * error, or -1 to leave them alone. They are closed in the child
+	 * once installed, other descriptors the child must not keep should
+	 * be close-on-exec. */
+	int fd[3];
+	/* The environment, or NULL to inherit ours; only allowed when the
+	 * program is given by pathname. */
+	char *const *envp;
+	/* Directory to chroot to before running the program, or NULL. */
+	const char *root;
+	/* Called in the child before running the program; it may only do
+	 * system calls, as the child might be sharing our memory. */
+	void (*setup)(void *data);
+	void *data;
+	/* Return -1 with errno set instead of failing when the child cannot
+	 * be created, for callers that must not throw, like cleanups. */
+	bool nonfatal;
+};
+
+#define SUBPROC_SPAWN_INIT { { -1, -1, -1 }, NULL, NULL, NULL, NULL, false }
+
+struct subproc_spawn_stats {
+	unsigned long spawns;
+	/* Time the parent was held up by the last spawn and all of them. */
+	unsigned long last_usecs;
+	unsigned long total_usecs;
+};
+
+pid_t subproc_spawn(const char *desc, const char *file,
+                    const char *const argv[], const struct subproc_spawn *sp);
+void subproc_spawn_get_stats(struct subproc_spawn_stats *stats);
+
 DPKG_END_DECLS
 
 #endif /* DPKG_SUBPROC_H */
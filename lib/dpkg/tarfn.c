@@ -8,6 +8,7 @@
 #include <config.h>
 #include <compat.h>
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -18,11 +19,16 @@
 
 #include <dpkg/macros.h>
 #include <dpkg/dpkg.h>
+#include <dpkg/varbuf.h>
 #include <dpkg/tarfn.h>
 
 #define TAR_MAGIC_USTAR "ustar\0" "00"
 #define TAR_MAGIC_GNU   "ustar "  " \0"
 
+/* Upper bound of the data of GNU long name and PAX pseudo entries, which
+ * are read into memory as a whole. */
+#define TAR_EXTENDED_MAX (1024 * 1024)
+
 struct TarHeader {
 	char Name[100];
 	char Mode[8];
@@ -44,11 +50,107 @@ typedef struct TarHeader TarHeader;
 
 static const size_t TarChecksumOffset = offsetof(TarHeader, Checksum);
 
-/* Octal-ASCII-to-long */
-static long
+/*
+ * Cache of user and group name to id lookups, kept for the whole run so
+ * that it is shared by all archives being extracted. Failed lookups are
+ * only remembered for the current archive, as a maintainer script run
+ * in between might have created the user or group.
+ */
+struct tar_name_cache {
+	struct tar_name_cache *next;
+	char name[33];
+	bool found;
+	unsigned long id;
+};
+
+static struct tar_name_cache *tar_user_cache, *tar_group_cache;
+static struct tar_name_cache_stats name_cache_stats;
+
+static struct tar_name_cache *
+tar_name_cache_lookup(struct tar_name_cache **cache, const char *field,
+                      size_t size, bool group)
+{
+	struct tar_name_cache *entry;
+	struct passwd *passwd;
+	struct group *grp;
+	char name[33];
+	size_t len;
+
+	len = strnlen(field, min(size, sizeof(name) - 1));
+	memcpy(name, field, len);
+	name[len] = '\0';
+
+	name_cache_stats.lookups++;
+
+	for (entry = *cache; entry; entry = entry->next) {
+		if (strcmp(entry->name, name) == 0) {
+			name_cache_stats.hits++;
+			return entry;
+		}
+	}
+
+	entry = m_malloc(sizeof(*entry));
+	strcpy(entry->name, name);
+	if (group) {
+		grp = getgrnam(name);
+		entry->found = grp != NULL;
+		entry->id = grp ? grp->gr_gid : 0;
+	} else {
+		passwd = getpwnam(name);
+		entry->found = passwd != NULL;
+		entry->id = passwd ? passwd->pw_uid : 0;
+	}
+	entry->next = *cache;
+	*cache = entry;
+
+	return entry;
+}
+
+static void
+tar_name_cache_forget_missing(struct tar_name_cache **cache)
+{
+	struct tar_name_cache *entry;
+
+	while ((entry = *cache)) {
+		if (entry->found) {
+			cache = &entry->next;
+		} else {
+			*cache = entry->next;
+			free(entry);
+		}
+	}
+}
+
+void
+tar_name_cache_get_stats(struct tar_name_cache_stats *stats)
+{
+	*stats = name_cache_stats;
+}
+
+/*
+ * Numeric header field to integer. Handles both the octal ASCII encoding
+ * and the GNU base-256 one used for values that do not fit.
+ */
+static off_t
 OtoL(const char *s, int size)
 {
-	int n = 0;
+	off_t n = 0;
+
+	if (*(const unsigned char *)s & 0x80) {
+		const unsigned char *u = (const unsigned char *)s;
+		unsigned long long v;
+
+		/* Big-endian two's complement, the marker bit of the first
+		 * byte doubles as the sign bit of negative values. */
+		if (*u & 0x40)
+			v = ~0ULL << 8 | *u++;
+		else
+			v = *u++ & 0x7f;
+		while (--size > 0)
+			v = (v << 8) | *u++;
+
+		return (off_t)(long long)v;
+	}
 
 	while (*s == ' ') {
 		s++;
@@ -61,50 +163,80 @@ OtoL(const char *s, int size)
 	return n;
 }
 
-/* String block to C null-terminated string */
+/* String block to C null-terminated string, stored in vb. */
 static char *
-StoC(const char *s, int size)
+StoC(struct varbuf *vb, const char *s, int size)
 {
-	int len;
-	char *str;
-
-	len = strnlen(s, size);
-	str = m_malloc(len + 1);
-	memcpy(str, s, len);
-	str[len] = '\0';
+	varbufreset(vb);
+	varbufaddbuf(vb, s, strnlen(s, size));
+	varbufaddc(vb, '\0');
 
-	return str;
+	return vb->buf;
 }
 
-/* FIXME: Rewrite using varbuf, once it supports the needed functionality. */
 static char *
-get_prefix_name(TarHeader *h)
+get_prefix_name(struct varbuf *vb, TarHeader *h)
 {
-	char *prefix, *name, *s;
-
-	/* The size is not going to be bigger than that. */
-	s = m_malloc(257);
-
-	prefix = StoC(h->Prefix, sizeof(h->Prefix));
-	name = StoC(h->Name, sizeof(h->Name));
+	varbufreset(vb);
+	varbufaddbuf(vb, h->Prefix, strnlen(h->Prefix, sizeof(h->Prefix)));
+	varbufaddc(vb, '/');
+	varbufaddbuf(vb, h->Name, strnlen(h->Name, sizeof(h->Name)));
+	varbufaddc(vb, '\0');
 
-	strcpy(s, prefix);
-	strcat(s, "/");
-	strcat(s, name);
+	return vb->buf;
+}
 
-	free(prefix);
-	free(name);
+/*
+ * Values from a PAX extended header. The strings point into the buffer
+ * holding the raw header data, which must outlive them.
+ */
+struct tar_pax {
+	const char *path;
+	const char *linkpath;
+	off_t size;
+	time_t mtime;
+	uid_t uid;
+	gid_t gid;
+	bool has_size;
+	bool has_mtime;
+	bool has_uid;
+	bool has_gid;
+	/* Whether an extended header has been read at all. */
+	bool present;
+};
 
-	return s;
-}
+/*
+ * Per-extractor state. All buffers are reused from entry to entry, so
+ * that decoding headers does not allocate once they are large enough.
+ */
+struct tar_extractor {
+	void *userData;
+	const TarFunctions *functions;
+
+	struct varbuf name;
+	struct varbuf linkname;
+	struct varbuf long_name;
+	struct varbuf long_link;
+	struct varbuf pax_data;
+	struct varbuf pax_global_data;
+
+	const char *next_long_name;
+	const char *next_long_link;
+	struct tar_pax pax;
+	struct tar_pax pax_global;
+
+	/* Whether the ids of the current entry come from its names. */
+	bool user_found;
+	bool group_found;
+};
 
 static int
-DecodeTarHeader(char * block, TarInfo * d)
+DecodeTarHeader(struct tar_extractor *t, char *block, TarInfo *d)
 {
 	TarHeader *h = (TarHeader *)block;
 	unsigned char *s = (unsigned char *)block;
-	struct passwd *passwd = NULL;
-	struct group *group = NULL;
+	struct tar_name_cache *user = NULL;
+	struct tar_name_cache *group = NULL;
 	unsigned int i;
 	long sum;
 	long checksum;
@@ -117,18 +249,20 @@ DecodeTarHeader(char * block, TarInfo * d)
 		d->format = tar_format_old;
 
 	if (*h->UserName)
-		passwd = getpwnam(h->UserName);
+		user = tar_name_cache_lookup(&tar_user_cache, h->UserName,
+		                             sizeof(h->UserName), false);
 	if (*h->GroupName)
-		group = getgrnam(h->GroupName);
+		group = tar_name_cache_lookup(&tar_group_cache, h->GroupName,
+		                              sizeof(h->GroupName), true);
 
 	/* Concatenate prefix and name to support ustar style long names. */
 	if (d->format == tar_format_ustar && h->Prefix[0] != '\0')
-		d->Name = get_prefix_name(h);
+		d->Name = get_prefix_name(&t->name, h);
 	else
-		d->Name = StoC(h->Name, sizeof(h->Name));
-	d->LinkName = StoC(h->LinkName, sizeof(h->LinkName));
+		d->Name = StoC(&t->name, h->Name, sizeof(h->Name));
+	d->LinkName = StoC(&t->linkname, h->LinkName, sizeof(h->LinkName));
 	d->Mode = (mode_t)OtoL(h->Mode, sizeof(h->Mode));
-	d->Size = (size_t)OtoL(h->Size, sizeof(h->Size));
+	d->Size = OtoL(h->Size, sizeof(h->Size));
 	d->ModTime = (time_t)OtoL(h->ModificationTime,
 	                          sizeof(h->ModificationTime));
 	d->Device = ((OtoL(h->MajorDevice,
@@ -139,11 +273,13 @@ DecodeTarHeader(char * block, TarInfo * d)
 	d->GroupID = (gid_t)OtoL(h->GroupID, sizeof(h->GroupID));
 	d->Type = (TarFileType)h->LinkFlag;
 
-	if (passwd)
-		d->UserID = passwd->pw_uid;
+	t->user_found = user && user->found;
+	if (t->user_found)
+		d->UserID = (uid_t)user->id;
 
-	if (group)
-		d->GroupID = group->gr_gid;
+	t->group_found = group && group->found;
+	if (t->group_found)
+		d->GroupID = (gid_t)group->id;
 
 	/* Treat checksum field as all blank. */
 	sum = ' ' * sizeof(h->Checksum);
@@ -154,7 +290,149 @@ DecodeTarHeader(char * block, TarInfo * d)
 	for (i = (512 - TarChecksumOffset - sizeof(h->Checksum)); i > 0; i--)
 		sum += *s++;
 
-	return (sum == checksum);
+	/* A negative size would make the callers read until the end of
+	 * the stream. */
+	return (sum == checksum) && d->Size >= 0;
+}
+
+/*
+ * Read the data blocks of a pseudo entry (GNU long name or PAX header)
+ * into vb, which gets NUL terminated.
+ */
+static int
+tar_read_extended(struct tar_extractor *t, struct varbuf *vb, off_t size)
+{
+	off_t left;
+	int status;
+
+	if (size > TAR_EXTENDED_MAX) {
+		/* Indicates broken tarfile: “Extended header too large”. */
+		errno = 0;
+		return -1;
+	}
+
+	varbufreset(vb);
+	varbuf_grow(vb, size + 512 + 1);
+
+	for (left = size; left > 0; left -= 512) {
+		status = t->functions->Read(t->userData, vb->buf + vb->used,
+		                            512);
+		/* If we didn't get 512 bytes read, punt. */
+		if (status != 512) {
+			/* Read partial header record? */
+			if (status > 0) {
+				errno = 0;
+				status = -1;
+			}
+			return status;
+		}
+		vb->used += min(left, 512);
+	}
+	vb->buf[vb->used] = '\0';
+
+	return 0;
+}
+
+/*
+ * Parse a decimal PAX value, which has to be wholly numeric. Sub-second
+ * precision, as found in mtime, is ignored.
+ */
+static int
+tar_pax_number(const char *value, bool fraction, long long *n)
+{
+	char *end;
+
+	if (*value == '\0')
+		return -1;
+	errno = 0;
+	*n = strtoll(value, &end, 10);
+	if (errno || end == value)
+		return -1;
+	if (fraction && *end == '.')
+		end += strspn(end + 1, "0123456789") + 1;
+
+	return *end == '\0' ? 0 : -1;
+}
+
+/*
+ * Parse the “<length> <keyword>=<value>\n” records of a PAX extended
+ * header in place, pointing the string values of pax into data.
+ */
+static int
+tar_pax_parse(char *data, size_t size, struct tar_pax *pax)
+{
+	char *rec = data, *end = data + size;
+
+	while (rec < end) {
+		char *key, *value, *eq;
+		unsigned long len;
+		long long n;
+
+		if (*rec < '0' || *rec > '9')
+			return -1;
+		len = strtoul(rec, &key, 10);
+		if (*key != ' ' || len == 0 ||
+		    len > (size_t)(end - rec) || rec[len - 1] != '\n')
+			return -1;
+		rec[len - 1] = '\0';
+		key++;
+
+		eq = strchr(key, '=');
+		if (eq == NULL)
+			return -1;
+		*eq = '\0';
+		value = eq + 1;
+
+		if (strcmp(key, "path") == 0) {
+			pax->path = *value ? value : NULL;
+		} else if (strcmp(key, "linkpath") == 0) {
+			pax->linkpath = *value ? value : NULL;
+		} else if (strcmp(key, "size") == 0) {
+			if (tar_pax_number(value, false, &n) < 0 || n < 0)
+				return -1;
+			pax->size = (off_t)n;
+			pax->has_size = true;
+		} else if (strcmp(key, "mtime") == 0) {
+			if (tar_pax_number(value, true, &n) < 0)
+				return -1;
+			pax->mtime = (time_t)n;
+			pax->has_mtime = true;
+		} else if (strcmp(key, "uid") == 0) {
+			if (tar_pax_number(value, false, &n) < 0 || n < 0)
+				return -1;
+			pax->uid = (uid_t)n;
+			pax->has_uid = true;
+		} else if (strcmp(key, "gid") == 0) {
+			if (tar_pax_number(value, false, &n) < 0 || n < 0)
+				return -1;
+			pax->gid = (gid_t)n;
+			pax->has_gid = true;
+		}
+
+		rec += len;
+	}
+	pax->present = true;
+
+	return 0;
+}
+
+static void
+tar_pax_apply(const struct tar_extractor *t, const struct tar_pax *pax,
+              TarInfo *d)
+{
+	if (pax->path)
+		d->Name = (char *)pax->path;
+	if (pax->linkpath)
+		d->LinkName = (char *)pax->linkpath;
+	if (pax->has_size)
+		d->Size = pax->size;
+	if (pax->has_mtime)
+		d->ModTime = pax->mtime;
+	/* A user or group name known on this system wins over the id. */
+	if (pax->has_uid && !t->user_found)
+		d->UserID = pax->uid;
+	if (pax->has_gid && !t->group_found)
+		d->GroupID = pax->gid;
 }
 
 typedef struct symlinkList {
@@ -168,16 +446,16 @@ TarExtractor(void *userData, const TarFunctions *functions)
 	int status;
 	char buffer[512];
 	TarInfo h;
-
-	char *next_long_name, *next_long_link;
-	char *bp;
-	char **longp;
-	int long_read;
+	struct tar_extractor t;
 	symlinkList *symListTop, *symListBottom, *symListPointer;
 
-	next_long_name = NULL;
-	next_long_link = NULL;
-	long_read = 0;
+	tar_name_cache_forget_missing(&tar_user_cache);
+	tar_name_cache_forget_missing(&tar_group_cache);
+
+	memset(&t, 0, sizeof(t));
+	t.userData = userData;
+	t.functions = functions;
+
 	symListBottom = symListPointer = symListTop = m_malloc(sizeof(symlinkList));
 	symListTop->next = NULL;
 
@@ -188,8 +466,8 @@ TarExtractor(void *userData, const TarFunctions *functions)
 	while ((status = functions->Read(userData, buffer, 512)) == 512) {
 		int nameLength;
 
-		if (!DecodeTarHeader(buffer, &h)) {
-			if (h.Name[0] == '\0') {
+		if (!DecodeTarHeader(&t, buffer, &h)) {
+			if (h.Name[0] == '\0' && h.Size == 0) {
 				/* End of tape. */
 				status = 0;
 			} else {
@@ -200,16 +478,81 @@ TarExtractor(void *userData, const TarFunctions *functions)
 			}
 			break;
 		}
-		if (h.Type != GNU_LONGLINK && h.Type != GNU_LONGNAME) {
-			if (next_long_name)
-				h.Name = next_long_name;
-
-			if (next_long_link)
-				h.LinkName = next_long_link;
+		status = 0;
 
-			next_long_link = NULL;
-			next_long_name = NULL;
+		switch (h.Type) {
+		case GNU_LONGLINK:
+		case GNU_LONGNAME:
+			/* The way the GNU long{link,name} stuff works is like
+			 * this:
+			 *
+			 * The first header is a “dummy” header that contains
+			 *   the size of the filename.
+			 * The next N headers contain the filename.
+			 * After the headers with the filename comes the
+			 *   “real” header with a bogus name or link. */
+			if (h.Type == GNU_LONGNAME) {
+				status = tar_read_extended(&t, &t.long_name,
+				                           h.Size);
+				t.next_long_name = t.long_name.buf;
+			} else {
+				status = tar_read_extended(&t, &t.long_link,
+				                           h.Size);
+				t.next_long_link = t.long_link.buf;
+			}
+			if (status != 0)
+				break;
+			continue;
+		case PAX_GLOBAL:
+			status = tar_read_extended(&t, &t.pax_global_data,
+			                           h.Size);
+			if (status != 0)
+				break;
+			memset(&t.pax_global, 0, sizeof(t.pax_global));
+			if (tar_pax_parse(t.pax_global_data.buf,
+			                  t.pax_global_data.used,
+			                  &t.pax_global) < 0) {
+				/* Indicates broken tarfile:
+				 * “Bad extended header”. */
+				errno = 0;
+				status = -1;
+				break;
+			}
+			continue;
+		case PAX_EXTENDED:
+			status = tar_read_extended(&t, &t.pax_data, h.Size);
+			if (status != 0)
+				break;
+			memset(&t.pax, 0, sizeof(t.pax));
+			if (tar_pax_parse(t.pax_data.buf, t.pax_data.used,
+			                  &t.pax) < 0) {
+				/* Indicates broken tarfile:
+				 * “Bad extended header”. */
+				errno = 0;
+				status = -1;
+				break;
+			}
+			continue;
+		default:
+			break;
 		}
+		if (status != 0)
+			break;
+
+		if (t.next_long_name)
+			h.Name = (char *)t.next_long_name;
+		if (t.next_long_link)
+			h.LinkName = (char *)t.next_long_link;
+		t.next_long_name = NULL;
+		t.next_long_link = NULL;
+
+		/* Extended header values take precedence over the ustar
+		 * header ones, and per-file ones over the global ones. */
+		tar_pax_apply(&t, &t.pax_global, &h);
+		tar_pax_apply(&t, &t.pax, &h);
+		if (t.pax.present || t.pax_global.present)
+			h.format = tar_format_pax;
+		memset(&t.pax, 0, sizeof(t.pax));
 
 		if (h.Name[0] == '\0') {
 			/* Indicates broken tarfile: “Bad header data”. */
@@ -253,53 +596,6 @@ TarExtractor(void *userData, const TarFunctions *functions)
 		case FIFO:
 			status = (*functions->MakeSpecialFile)(&h);
 			break;
-		case GNU_LONGLINK:
-		case GNU_LONGNAME:
-			/* Set longp to the location of the long filename or
-			 * link we're trying to deal with. */
-			longp = ((h.Type == GNU_LONGNAME) ?
-			         &next_long_name :
-			         &next_long_link);
-
-			if (*longp)
-				free(*longp);
-
-			*longp = m_malloc(h.Size);
-			bp = *longp;
-
-			/* The way the GNU long{link,name} stuff works is like
-			 * this:
-			 *
-			 * The first header is a “dummy” header that contains
-			 *   the size of the filename.
-			 * The next N headers contain the filename.
-			 * After the headers with the filename comes the
-			 *   “real” header with a bogus name or link. */
-			for (long_read = h.Size;
-			     long_read > 0;
-			     long_read -= 512) {
-				int copysize;
-
-				status = functions->Read(userData, buffer, 512);
-				/* If we didn't get 512 bytes read, punt. */
-				if (512 != status) {
-					 /* Read partial header record? */
-					if (status > 0) {
-						errno = 0;
-						status = -1;
-					}
-					break;
-				}
-				copysize = min(long_read, 512);
-				memcpy (bp, buffer, copysize);
-				bp += copysize;
-			};
-
-			/* This decode function expects status to be 0 after
-			 * the case statement if we successfully decoded. I
-			 * guess what we just did was successful. */
-			status = 0;
-			break;
 		default:
 			/* Indicates broken tarfile: “Bad header field”. */
 			errno = 0;
@@ -320,8 +616,13 @@ TarExtractor(void *userData, const TarFunctions *functions)
 		symListPointer = symListBottom;
 	}
 	free(symListPointer);
-	free(h.Name);
-	free(h.LinkName);
+
+	varbuffree(&t.name);
+	varbuffree(&t.linkname);
+	varbuffree(&t.long_name);
+	varbuffree(&t.long_link);
+	varbuffree(&t.pax_data);
+	varbuffree(&t.pax_global_data);
 
 	if (status > 0) {
 		/* Indicates broken tarfile: “Read partial header record”. */
@@ -332,4 +633,3 @@ TarExtractor(void *userData, const TarFunctions *functions)
 		return status;
 	}
 }
-
@@ -29,7 +29,9 @@ enum TarFileType {
 	Directory = '5',
 	FIFO = '6',
 	GNU_LONGLINK = 'K',
-	GNU_LONGNAME = 'L'
+	GNU_LONGNAME = 'L',
+	PAX_GLOBAL = 'g',
+	PAX_EXTENDED = 'x',
 };
 typedef enum TarFileType	TarFileType;
 
@@ -38,7 +40,7 @@ struct	TarInfo {
 	void *		UserData;	/* User passed this in as argument */
 	char *		Name;		/* File name */
 	mode_t		Mode;		/* Unix mode, including device bits. */
-	size_t		Size;		/* Size of file */
+	off_t		Size;		/* Size of file */
 	time_t		ModTime;	/* Last-modified time */
 	TarFileType	Type;		/* Regular, Directory, Special, Link */
 	char *		LinkName;	/* Name for symbolic and hard links */
@@ -62,6 +64,13 @@ struct TarFunctions {
 };
 typedef struct TarFunctions	TarFunctions;
 
+struct tar_name_cache_stats {
+	unsigned long lookups;
+	unsigned long hits;
+};
+
 int TarExtractor(void *userData, const TarFunctions *functions);
 
+void tar_name_cache_get_stats(struct tar_name_cache_stats *stats);
+
 #endif
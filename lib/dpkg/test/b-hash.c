@@ -0,0 +1,86 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * b-hash.c - message digest throughput benchmark
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with dpkg; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <config.h>
+#include <compat.h>
+
+#include <sys/time.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <dpkg/hash.h>
+
+#define BENCH_BUFSIZE	(32 * 1024)
+#define BENCH_TOTAL	(256 * 1024 * 1024)
+
+static double
+now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void
+bench(enum hash_type type, const char *name, const unsigned char *buf)
+{
+	struct hash_context ctx;
+	char hex[SHA256HASHLEN + 1];
+	double start, elapsed;
+	size_t done;
+
+	start = now();
+	hash_init(&ctx, type);
+	for (done = 0; done < BENCH_TOTAL; done += BENCH_BUFSIZE)
+		hash_update(&ctx, buf, BENCH_BUFSIZE);
+	hash_final(&ctx, hex);
+	elapsed = now() - start;
+
+	printf("%-8s %-12s %8.1f MiB/s\n", name, hash_impl_name(type),
+	       BENCH_TOTAL / (1024.0 * 1024.0) / elapsed);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const char *const sha256_impls[] = {
+		"generic", "x86-sha", "armv8-sha2", NULL,
+	};
+	unsigned char *buf;
+	int i;
+
+	buf = malloc(BENCH_BUFSIZE);
+	if (!buf)
+		return 1;
+	for (i = 0; i < BENCH_BUFSIZE; i++)
+		buf[i] = i * 7;
+
+	bench(HASH_MD5, "md5", buf);
+	for (i = 0; sha256_impls[i]; i++)
+		if (sha256_set_impl(sha256_impls[i]))
+			bench(HASH_SHA256, "sha256", buf);
+
+	free(buf);
+
+	return 0;
+}
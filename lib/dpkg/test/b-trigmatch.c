@@ -0,0 +1,209 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * b-trigmatch.c - file trigger interest matching benchmark
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with dpkg; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <config.h>
+#include <compat.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <dpkg/dpkg.h>
+#include <dpkg/dpkg-db.h>
+
+#define BENCH_INTERESTS	256
+#define BENCH_PATHS	(256 * 1024)
+#define BENCH_BINS	65521
+
+const char thisname[] = "b-trigmatch";
+
+/* A hashed namenode table, like the one dpkg proper uses. */
+struct filenamenode {
+	struct filenamenode *next;
+	const char *name;
+	struct trigfileint *trig_interested;
+};
+
+static struct filenamenode *bins[BENCH_BINS];
+
+static unsigned int
+hash(const char *name)
+{
+	unsigned int h = 0;
+
+	while (*name)
+		h = h * 33 + (unsigned char)*name++;
+
+	return h % BENCH_BINS;
+}
+
+static struct filenamenode *
+bench_nn_find(const char *name, int nonew)
+{
+	struct filenamenode **bin = &bins[hash(name)], *fnn;
+
+	for (fnn = *bin; fnn; fnn = fnn->next)
+		if (!strcmp(fnn->name, name))
+			return fnn;
+	if (nonew)
+		return NULL;
+
+	fnn = m_malloc(sizeof(*fnn));
+	fnn->name = m_strdup(name);
+	fnn->trig_interested = NULL;
+	fnn->next = *bin;
+	*bin = fnn;
+
+	return fnn;
+}
+
+TRIGHOOKS_DEFINE_NAMENODE_ACCESSORS
+
+static double
+now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void
+count_interest(struct trigfileint *tfi, void *user)
+{
+	unsigned long *matches = user;
+
+	(*matches)++;
+}
+
+/*
+ * The per-node lookup: every parent directory of the path has to be
+ * looked up on its own, as if it had an entry in the archive.
+ */
+static unsigned long
+match_pernode(const char *path)
+{
+	struct filenamenode *fnn;
+	struct trigfileint *tfi;
+	char buf[256];
+	unsigned long matches = 0;
+	const char *p;
+
+	for (p = strchr(path + 1, '/'); ; p = strchr(p + 1, '/')) {
+		size_t len = p ? (size_t)(p - path) : strlen(path);
+
+		memcpy(buf, path, len);
+		buf[len] = '\0';
+		fnn = bench_nn_find(buf, 1);
+		if (fnn)
+			for (tfi = fnn->trig_interested; tfi;
+			     tfi = tfi->samefile_next)
+				matches++;
+		if (!p)
+			break;
+	}
+
+	return matches;
+}
+
+static unsigned long
+match_tree(const char *path)
+{
+	unsigned long matches = 0;
+
+	trig_file_interests_match(path, count_interest, &matches);
+
+	return matches;
+}
+
+static void
+bench(const char *name, unsigned long (*match)(const char *path),
+      char **paths, unsigned long *matches)
+{
+	double start, elapsed;
+	int i;
+
+	*matches = 0;
+	start = now();
+	for (i = 0; i < BENCH_PATHS; i++)
+		*matches += match(paths[i]);
+	elapsed = now() - start;
+
+	printf("%-10s %8.1f ns/path %8lu matches\n", name,
+	       elapsed * 1e9 / BENCH_PATHS, *matches);
+}
+
+int
+main(int argc, char **argv)
+{
+	char filename[] = "/tmp/b-trigmatch.XXXXXX";
+	jmp_buf ejbuf;
+	char **paths;
+	unsigned long pernode, tree;
+	FILE *f;
+	int fd, i;
+
+	standard_startup(&ejbuf);
+
+	trigh.namenode_find = bench_nn_find;
+	trigh.namenode_interested = th_nn_interested;
+	trigh.namenode_name = th_nn_name;
+
+	fd = mkstemp(filename);
+	if (fd < 0)
+		return 1;
+	f = fdopen(fd, "w");
+	for (i = 0; i < BENCH_INTERESTS; i++)
+		fprintf(f, "/usr/share/d%d pkg%d\n", i, i % 16);
+	fprintf(f, "/usr/share/d0/s0 pkg0\n");
+	fprintf(f, "/usr/lib pkg1\n");
+	fclose(f);
+
+	triggersfilefile = filename;
+	trig_file_interests_ensure();
+	unlink(filename);
+
+	paths = m_malloc(BENCH_PATHS * sizeof(*paths));
+	for (i = 0; i < BENCH_PATHS; i++) {
+		char buf[256];
+
+		snprintf(buf, sizeof(buf), "/usr/%s/d%d/s%d/f%d",
+		         (i % 4) ? "share" : "local", i % 1024, i % 7, i);
+		paths[i] = m_strdup(buf);
+	}
+
+	bench("per-node", match_pernode, paths, &pernode);
+	bench("tree", match_tree, paths, &tree);
+
+	if (pernode != tree) {
+		fprintf(stderr, "mismatched results\n");
+		return 1;
+	}
+
+	standard_shutdown();
+
+	return 0;
+}
@@ -22,6 +22,12 @@
 #include <dpkg/test.h>
 #include <dpkg/buffer.h>
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
 #include <stdio.h>
 
 static void
@@ -38,9 +44,96 @@ test_buffer_hash(void)
 	test_str(hash, ==, "475aae3b885d70a9130eec23ab33f2b9");
 }
 
+static void
+test_fd_fd_copy_and_md5(void)
+{
+	const char str_test[] = "this is a test string\n";
+	char hash[MD5HASHLEN + 1];
+	char buf[sizeof(str_test)];
+	int p_in[2], p_out[2];
+	ssize_t len;
+	off_t size;
+	int ret;
+
+	ret = pipe(p_in);
+	test_pass(ret == 0);
+	ret = pipe(p_out);
+	test_pass(ret == 0);
+
+	len = write(p_in[1], str_test, strlen(str_test));
+	test_pass(len == (ssize_t)strlen(str_test));
+	close(p_in[1]);
+
+	size = fd_fd_copy_and_md5(p_in[0], p_out[1], hash, -1, "test");
+	test_pass(size == (off_t)strlen(str_test));
+	test_str(hash, ==, "475aae3b885d70a9130eec23ab33f2b9");
+	close(p_in[0]);
+	close(p_out[1]);
+
+	memset(buf, 0, sizeof(buf));
+	len = read(p_out[0], buf, sizeof(buf));
+	test_pass(len == (ssize_t)strlen(str_test));
+	test_str(buf, ==, str_test);
+	close(p_out[0]);
+}
+
+static void
+test_fd_fd_copy_file(void)
+{
+	char fn_in[] = "t-buffer.in.XXXXXX";
+	char fn_out[] = "t-buffer.out.XXXXXX";
+	const size_t size = 300000;
+	struct buffer_copy_stats stats;
+	char *buf, *check;
+	int fd_in, fd_out;
+	ssize_t len;
+	off_t ret;
+	size_t i;
+
+	buf = malloc(size);
+	check = malloc(size);
+	test_pass(buf != NULL && check != NULL);
+	for (i = 0; i < size; i++)
+		buf[i] = i % 251;
+
+	fd_in = mkstemp(fn_in);
+	test_pass(fd_in >= 0);
+	fd_out = mkstemp(fn_out);
+	test_pass(fd_out >= 0);
+	len = write(fd_in, buf, size);
+	test_pass(len == (ssize_t)size);
+
+	/* Copy all but the first and last 1000 bytes. */
+	ret = lseek(fd_in, 1000, SEEK_SET);
+	test_pass(ret == 1000);
+	ret = fd_fd_copy(fd_in, fd_out, size - 2000, "test");
+	test_pass(ret == (off_t)(size - 2000));
+	ret = lseek(fd_in, 0, SEEK_CUR);
+	test_pass(ret == (off_t)(size - 1000));
+
+	ret = lseek(fd_out, 0, SEEK_SET);
+	test_pass(ret == 0);
+	len = read(fd_out, check, size);
+	test_pass(len == (ssize_t)(size - 2000));
+	test_mem(check, ==, buf + 1000, size - 2000);
+
+	buffer_copy_get_stats(&stats);
+	test_pass(stats.copies >= 1);
+	test_pass(stats.bytes >= (off_t)(size - 2000));
+
+	close(fd_in);
+	close(fd_out);
+	unlink(fn_in);
+	unlink(fn_out);
+	free(buf);
+	free(check);
+}
+
 static void
 test(void)
 {
 	test_buffer_hash();
+	test_fd_fd_copy_and_md5();
+	test_fd_fd_copy_file();
 }
 
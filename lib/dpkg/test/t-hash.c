@@ -0,0 +1,144 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * t-hash.c - test message digest handling
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with dpkg; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <dpkg/test.h>
+#include <dpkg/hash.h>
+#include <dpkg/buffer.h>
+
+#include <stdlib.h>
+
+static const char *const sha256_impls[] = {
+	"generic",
+	"x86-sha",
+	"armv8-sha2",
+	NULL,
+};
+
+static void
+hash_str(enum hash_type type, const char *str, size_t len, size_t chunk,
+         char *hex)
+{
+	struct hash_context ctx;
+	size_t n;
+
+	hash_init(&ctx, type);
+	while (len) {
+		n = len < chunk ? len : chunk;
+		hash_update(&ctx, str, n);
+		str += n;
+		len -= n;
+	}
+	hash_final(&ctx, hex);
+}
+
+static void
+test_hash_md5(void)
+{
+	char hash[MD5HASHLEN + 1];
+
+	hash_str(HASH_MD5, "", 0, 1, hash);
+	test_str(hash, ==, "d41d8cd98f00b204e9800998ecf8427e");
+
+	hash_str(HASH_MD5, "abc", 3, 1, hash);
+	test_str(hash, ==, "900150983cd24fb0d6963f7d28e17f72");
+
+	buffer_md5("abc", hash, 3);
+	test_str(hash, ==, "900150983cd24fb0d6963f7d28e17f72");
+}
+
+static void
+test_hash_sha256(void)
+{
+	const char str_long[] =
+		"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+	char hash[SHA256HASHLEN + 1];
+
+	hash_str(HASH_SHA256, "", 0, 1, hash);
+	test_str(hash, ==, "e3b0c44298fc1c149afbf4c8996fb924"
+	                   "27ae41e4649b934ca495991b7852b855");
+
+	hash_str(HASH_SHA256, "abc", 3, 1, hash);
+	test_str(hash, ==, "ba7816bf8f01cfea414140de5dae2223"
+	                   "b00361a396177a9cb410ff61f20015ad");
+
+	hash_str(HASH_SHA256, str_long, strlen(str_long), 7, hash);
+	test_str(hash, ==, "248d6a61d20638b8e5c026930c3e6039"
+	                   "a33ce45964ff2167f6ecedd419db06c1");
+
+	buffer_sha256("abc", hash, 3);
+	test_str(hash, ==, "ba7816bf8f01cfea414140de5dae2223"
+	                   "b00361a396177a9cb410ff61f20015ad");
+}
+
+/*
+ * Hash a large buffer at different alignments and in different chunk
+ * sizes, which must all give the same result, for each implementation
+ * this CPU supports.
+ */
+static void
+test_hash_large(void)
+{
+	const size_t size = 1000000;
+	const size_t chunks[] = { 1, 63, 64, 65, 4096, 1000000 };
+	char *buf;
+	char md5_ref[MD5HASHLEN + 1], md5_hash[MD5HASHLEN + 1];
+	char sha_ref[SHA256HASHLEN + 1], sha_hash[SHA256HASHLEN + 1];
+	size_t i, c;
+	int impl;
+
+	buf = malloc(size + 1);
+	test_pass(buf != NULL);
+	memset(buf, 'a', size + 1);
+
+	/* The one million 'a' test vectors. */
+	hash_str(HASH_MD5, buf, size, size, md5_ref);
+	test_str(md5_ref, ==, "7707d6ae4e027c70eea2a935c2296f21");
+
+	test_pass(sha256_set_impl("generic"));
+	hash_str(HASH_SHA256, buf, size, size, sha_ref);
+	test_str(sha_ref, ==, "cdc76e5c9914fb9281a1c7e284d73e67"
+	                      "f1809a48a497200e046d39ccc7112cd0");
+
+	for (impl = 0; sha256_impls[impl]; impl++) {
+		if (!sha256_set_impl(sha256_impls[impl]))
+			continue;
+
+		for (c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+			for (i = 0; i < 2; i++) {
+				hash_str(HASH_MD5, buf + i, size, chunks[c],
+				         md5_hash);
+				test_str(md5_hash, ==, md5_ref);
+
+				hash_str(HASH_SHA256, buf + i, size, chunks[c],
+				         sha_hash);
+				test_str(sha_hash, ==, sha_ref);
+			}
+		}
+	}
+
+	free(buf);
+}
+
+static void
+test(void)
+{
+	test_hash_md5();
+	test_hash_sha256();
+	test_hash_large();
+}
@@ -0,0 +1,396 @@
+/*
+ * libdpkg - Debian packaging suite library routines
+ * t-tar.c - test tar header decoding
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with dpkg; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <dpkg/test.h>
+#include <dpkg/tarfn.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TEST_MAX_ENTRIES	8
+
+struct test_header {
+	char name[100];
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char size[12];
+	char mtime[12];
+	char checksum[8];
+	char linkflag;
+	char linkname[100];
+	char magic[8];
+	char uname[32];
+	char gname[32];
+	char devmajor[8];
+	char devminor[8];
+	char pad[167];
+};
+
+struct test_entry {
+	char name[512];
+	char linkname[512];
+	TarFileType type;
+	off_t size;
+	time_t mtime;
+	uid_t uid;
+	gid_t gid;
+	enum tar_format format;
+};
+
+/* An in-memory archive, and the entries seen while extracting it. */
+struct test_tar {
+	char data[16 * 512];
+	size_t used;
+	size_t pos;
+
+	struct test_entry entries[TEST_MAX_ENTRIES];
+	int nentries;
+};
+
+static void
+test_header_init(struct test_header *h, const char *name, TarFileType type,
+                 off_t size)
+{
+	memset(h, 0, sizeof(*h));
+	memcpy(h->name, name, strlen(name));
+	sprintf(h->mode, "%07o", 0644);
+	sprintf(h->uid, "%07o", 0);
+	sprintf(h->gid, "%07o", 0);
+	sprintf(h->size, "%011llo", (unsigned long long)size);
+	sprintf(h->mtime, "%011o", 0);
+	h->linkflag = type;
+	memcpy(h->magic, "ustar  ", 8);
+}
+
+static void
+test_tar_put(struct test_tar *tar, const void *data, size_t len)
+{
+	assert(tar->used + len <= sizeof(tar->data));
+	memcpy(tar->data + tar->used, data, len);
+	tar->used += len;
+	if (len % 512) {
+		memset(tar->data + tar->used, 0, 512 - len % 512);
+		tar->used += 512 - len % 512;
+	}
+}
+
+static void
+test_tar_put_header(struct test_tar *tar, struct test_header *h)
+{
+	const unsigned char *s = (const unsigned char *)h;
+	unsigned int sum = 0;
+	size_t i;
+
+	memset(h->checksum, ' ', sizeof(h->checksum));
+	for (i = 0; i < sizeof(*h); i++)
+		sum += s[i];
+	sprintf(h->checksum, "%06o", sum);
+	h->checksum[7] = ' ';
+
+	test_tar_put(tar, h, sizeof(*h));
+}
+
+static void
+test_tar_put_pax(struct test_tar *tar, TarFileType type, const char *records)
+{
+	struct test_header h;
+
+	test_header_init(&h, "./PaxHeaders/x", type, strlen(records));
+	test_tar_put_header(tar, &h);
+	test_tar_put(tar, records, strlen(records));
+}
+
+static void
+test_tar_put_file(struct test_tar *tar, const char *name, const char *data)
+{
+	struct test_header h;
+
+	test_header_init(&h, name, NormalFile1, strlen(data));
+	test_tar_put_header(tar, &h);
+	test_tar_put(tar, data, strlen(data));
+}
+
+static void
+test_tar_put_end(struct test_tar *tar)
+{
+	char block[512];
+
+	memset(block, 0, sizeof(block));
+	test_tar_put(tar, block, sizeof(block));
+	test_tar_put(tar, block, sizeof(block));
+}
+
+static int
+test_tar_read(void *data, char *buf, int len)
+{
+	struct test_tar *tar = data;
+
+	if ((size_t)len > tar->used - tar->pos)
+		len = tar->used - tar->pos;
+	memcpy(buf, tar->data + tar->pos, len);
+	tar->pos += len;
+
+	return len;
+}
+
+static int
+test_tar_entry(TarInfo *ti)
+{
+	struct test_tar *tar = ti->UserData;
+	struct test_entry *e;
+
+	assert(tar->nentries < TEST_MAX_ENTRIES);
+	e = &tar->entries[tar->nentries++];
+	assert(strlen(ti->Name) < sizeof(e->name));
+	assert(strlen(ti->LinkName) < sizeof(e->linkname));
+	strcpy(e->name, ti->Name);
+	strcpy(e->linkname, ti->LinkName);
+	e->type = ti->Type;
+	e->size = ti->Size;
+	e->mtime = ti->ModTime;
+	e->uid = ti->UserID;
+	e->gid = ti->GroupID;
+	e->format = ti->format;
+
+	return 0;
+}
+
+static int
+test_tar_file(TarInfo *ti)
+{
+	struct test_tar *tar = ti->UserData;
+
+	test_tar_entry(ti);
+	/* Skip the data and its padding. */
+	tar->pos += (ti->Size + 511) / 512 * 512;
+	assert(tar->pos <= tar->used);
+
+	return 0;
+}
+
+static const TarFunctions test_tar_functions = {
+	.Read = test_tar_read,
+	.ExtractFile = test_tar_file,
+	.MakeDirectory = test_tar_entry,
+	.MakeHardLink = test_tar_entry,
+	.MakeSymbolicLink = test_tar_entry,
+	.MakeSpecialFile = test_tar_entry,
+};
+
+static int
+test_tar_extract(struct test_tar *tar)
+{
+	tar->pos = 0;
+	tar->nentries = 0;
+
+	return TarExtractor(tar, &test_tar_functions);
+}
+
+static void
+test_tar_pax_paths(void)
+{
+	struct test_tar *tar = m_malloc(sizeof(*tar));
+	struct test_header h;
+	char records[512];
+	char path[300];
+	int i;
+
+	/* A path that does not fit in the ustar name field. */
+	strcpy(path, "./usr/share");
+	for (i = 0; i < 25; i++)
+		strcat(path, "/component");
+
+	tar->used = 0;
+	sprintf(records, "%zu path=%s\n",
+	        strlen(path) + strlen(" path=\n") + 3, path);
+	strcat(records, "26 linkpath=../new/target\n");
+	test_tar_put_pax(tar, PAX_EXTENDED, records);
+	test_header_init(&h, "./short", HardLink, 0);
+	memcpy(h.linkname, "./old", 5);
+	test_tar_put_header(tar, &h);
+	/* The overrides only apply to the entry that follows them. */
+	test_tar_put_file(tar, "./plain", "data");
+	test_tar_put_end(tar);
+
+	test_pass(test_tar_extract(tar) == 0);
+	test_pass(tar->nentries == 2);
+	test_str(tar->entries[0].name, ==, path);
+	test_str(tar->entries[0].linkname, ==, "../new/target");
+	test_pass(tar->entries[0].format == tar_format_pax);
+	test_str(tar->entries[1].name, ==, "./plain");
+	test_str(tar->entries[1].linkname, ==, "");
+	test_pass(tar->entries[1].size == 4);
+	test_pass(tar->entries[1].format == tar_format_gnu);
+
+	free(tar);
+}
+
+static void
+test_tar_pax_numbers(void)
+{
+	struct test_tar *tar = m_malloc(sizeof(*tar));
+	struct test_header h;
+
+	tar->used = 0;
+	test_tar_put_pax(tar, PAX_GLOBAL, "12 mtime=42\n");
+	test_tar_put_pax(tar, PAX_EXTENDED,
+	                 "10 size=5\n"
+	                 "15 uid=4000000\n"
+	                 "12 gid=1234\n"
+	                 "23 mtime=1234567890.25\n");
+	/* The header fields are overridden by the extended header ones. */
+	test_header_init(&h, "./big", NormalFile1, 0);
+	sprintf(h.uid, "%07o", 7);
+	test_tar_put_header(tar, &h);
+	test_tar_put(tar, "12345", 5);
+	test_tar_put_file(tar, "./small", "abc");
+	test_tar_put_end(tar);
+
+	test_pass(test_tar_extract(tar) == 0);
+	test_pass(tar->nentries == 2);
+	test_str(tar->entries[0].name, ==, "./big");
+	test_pass(tar->entries[0].size == 5);
+	test_pass(tar->entries[0].uid == 4000000);
+	test_pass(tar->entries[0].gid == 1234);
+	test_pass(tar->entries[0].mtime == 1234567890);
+	/* The global header still applies after the per-entry one. */
+	test_str(tar->entries[1].name, ==, "./small");
+	test_pass(tar->entries[1].size == 3);
+	test_pass(tar->entries[1].uid == 0);
+	test_pass(tar->entries[1].mtime == 42);
+	test_pass(tar->entries[1].format == tar_format_pax);
+
+	free(tar);
+}
+
+static void
+test_tar_pax_malformed(void)
+{
+	static const char *const bad[] = {
+		/* Not a number. */
+		"xx path=abc\n",
+		/* Leading space or sign. */
+		" 12 path=abc\n",
+		"-12 path=abc\n",
+		/* Zero, too short, too long. */
+		"0 path=abc\n",
+		"5 path=abc\n",
+		"99 path=abc\n",
+		/* Huge. */
+		"99999999999999999999999 path=abc\n",
+		/* No separator after the length, or no keyword. */
+		"12path=abcde\n",
+		"13 pathabcde\n",
+		/* Bad numeric values. */
+		"12 size=1x4\n",
+		"11 size=-1\n",
+		"8 size=\n",
+		"15 mtime=1.2.3\n",
+		"15 uid=999999x\n",
+		NULL,
+	};
+	struct test_tar *tar = m_malloc(sizeof(*tar));
+	struct test_header h;
+	int i;
+
+	for (i = 0; bad[i]; i++) {
+		tar->used = 0;
+		test_tar_put_pax(tar, PAX_EXTENDED, bad[i]);
+		test_tar_put_file(tar, "./file", "data");
+		test_tar_put_end(tar);
+
+		test_pass(test_tar_extract(tar) == -1);
+		test_pass(tar->nentries == 0);
+	}
+
+	/* A negative base-256 size, which would read to the end. */
+	tar->used = 0;
+	test_header_init(&h, "./file", NormalFile1, 0);
+	memset(h.size, 0xff, sizeof(h.size));
+	test_tar_put_header(tar, &h);
+	test_tar_put_file(tar, "./next", "data");
+	test_tar_put_end(tar);
+
+	test_pass(test_tar_extract(tar) == -1);
+	test_pass(tar->nentries == 0);
+
+	/* Pseudo entries too large to be read into memory. */
+	for (i = 0; i < 2; i++) {
+		tar->used = 0;
+		test_header_init(&h, "././@LongLink",
+		                 i ? PAX_EXTENDED : GNU_LONGNAME, 0);
+		memcpy(h.size, "\x80\0\0\0\0\0\x01\0\0\0\0\0", 12);
+		test_tar_put_header(tar, &h);
+		test_tar_put_file(tar, "./file", "data");
+		test_tar_put_end(tar);
+
+		test_pass(test_tar_extract(tar) == -1);
+		test_pass(tar->nentries == 0);
+	}
+
+	free(tar);
+}
+
+static void
+test_tar_base256(void)
+{
+	struct test_tar *tar = m_malloc(sizeof(*tar));
+	struct test_header h;
+
+	tar->used = 0;
+
+	/* Negative mtime, -1 and -2^33, and a uid beyond the octal range. */
+	test_header_init(&h, "./neg1", NormalFile1, 0);
+	memset(h.mtime, 0xff, sizeof(h.mtime));
+	memcpy(h.uid, "\x80\0\0\0\0\x2d\xc6\xc0", 8);
+	test_tar_put_header(tar, &h);
+
+	test_header_init(&h, "./neg2", NormalFile1, 0);
+	memcpy(h.mtime, "\xff\xff\xff\xff\xff\xff\xff\xfe\0\0\0\0", 12);
+	test_tar_put_header(tar, &h);
+
+	/* A large mtime, 2^40, and a large size, 2^33 + 5. */
+	test_header_init(&h, "./large", Directory, 0);
+	memcpy(h.mtime, "\x80\0\0\0\0\0\x01\0\0\0\0\0", 12);
+	memcpy(h.size, "\x80\0\0\0\0\0\0\x02\0\0\0\x05", 12);
+	h.linkflag = Directory;
+	test_tar_put_header(tar, &h);
+	test_tar_put_end(tar);
+
+	test_pass(test_tar_extract(tar) == 0);
+	test_pass(tar->nentries == 3);
+	test_pass(tar->entries[0].mtime == -1);
+	test_pass(tar->entries[0].uid == 3000000);
+	test_pass(tar->entries[1].mtime == -((time_t)1 << 33));
+	if (sizeof(time_t) > 4)
+		test_pass(tar->entries[2].mtime == (time_t)1 << 40);
+	test_pass(tar->entries[2].size == ((off_t)1 << 33) + 5);
+
+	free(tar);
+}
+
+static void
+test(void)
+{
+	test_tar_pax_paths();
+	test_tar_pax_numbers();
+	test_tar_pax_malformed();
+	test_tar_base256();
+}
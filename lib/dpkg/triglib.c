@@ -26,6 +26,8 @@
 #include <dpkg/i18n.h>
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <errno.h>
 
@@ -74,6 +76,69 @@ illegal_triggername(const char *p)
  * comment in deppossi_ok_found regarding this situation.)
  */
 
+/*
+ * Activations already recorded during this run. The same activation tends
+ * to be repeated once per file of a package, and recording it again only
+ * scans the pending and awaited lists to find out it was there already.
+ * This is a direct mapped cache, so a collision just means recording the
+ * activation again. The names are all allocated with nfmalloc, so they
+ * stay valid for the run. The cache is invalidated whenever pending or
+ * awaited triggers might be removed from any package.
+ */
+
+#define TRIG_ACTIVATION_CACHE_SIZE	1024
+
+struct trig_activation {
+	const struct pkginfo *pend, *aw;
+	const char *trig;
+	unsigned long generation;
+};
+
+static struct trig_activation trig_activation_cache[TRIG_ACTIVATION_CACHE_SIZE];
+static unsigned long trig_activation_generation = 1;
+static struct trig_activation_stats trig_activation_stats;
+
+void
+trig_activation_forget(void)
+{
+	trig_activation_generation++;
+}
+
+void
+trig_activation_get_stats(struct trig_activation_stats *stats)
+{
+	*stats = trig_activation_stats;
+}
+
+/* Returns true if the activation had already been recorded. */
+static bool
+trig_activation_seen(struct pkginfo *pend, struct pkginfo *aw,
+                     const char *trig)
+{
+	struct trig_activation *ta;
+	unsigned long h;
+	const char *p;
+
+	/* Explicit trigger names are copied for each activation, so go by
+	 * the name, not the pointer. */
+	h = ((unsigned long)pend >> 4) ^ ((unsigned long)aw >> 2);
+	for (p = trig; *p; p++)
+		h = h * 33 + (unsigned char)*p;
+	ta = &trig_activation_cache[h % TRIG_ACTIVATION_CACHE_SIZE];
+
+	if (ta->generation == trig_activation_generation &&
+	    ta->pend == pend && ta->aw == aw &&
+	    (ta->trig == trig || strcmp(ta->trig, trig) == 0))
+		return true;
+
+	ta->pend = pend;
+	ta->aw = aw;
+	ta->trig = trig;
+	ta->generation = trig_activation_generation;
+
+	return false;
+}
+
 /* aw might be NULL, and trig is not copied! */
 static void
 trig_record_activation(struct pkginfo *pend, struct pkginfo *aw, const char *trig)
@@ -82,12 +147,21 @@ trig_record_activation(struct pkginfo *pend, struct pkginfo *aw, const char *tri
 		/* Not interested then. */
 		return;
 
-	if (trig_note_pend(pend, trig))
-		modstatdb_note_ifwrite(pend);
+	trig_activation_stats.seen++;
 
+	/* This is cheap, and keeps the deferred queue right even if the
+	 * package has been processed and dequeued since. */
 	if (trigh.enqueue_deferred)
 		trigh.enqueue_deferred(pend);
 
+	if (trig_activation_seen(pend, aw, trig))
+		return;
+
+	trig_activation_stats.recorded++;
+
+	if (trig_note_pend(pend, trig))
+		modstatdb_note_ifwrite(pend);
+
 	if (aw && pend->status > stat_configfiles)
 		if (trig_note_aw(pend, aw)) {
 			if (aw->status > stat_triggersawaited)
@@ -158,6 +232,8 @@ trig_clear_awaiters(struct pkginfo *notpend)
 
 	assert(!notpend->trigpend_head);
 
+	trig_activation_forget();
+
 	ta = notpend->othertrigaw_head;
 	notpend->othertrigaw_head = NULL;
 	for (; ta; ta = ta->nextsamepend) {
@@ -428,6 +504,154 @@ static struct {
  */
 static int filetriggers_edited = -1;
 
+/*
+ * Directory prefix tree of the file trigger interests, one node per path
+ * component. It is built as the interests are read in and kept up to date
+ * as they are added, so that a path can be matched against the interests
+ * in it and in all its parent directories with a single walk down the
+ * tree, whether or not the parent directories themselves are touched.
+ *
+ * The children of all the nodes live in a single hash table keyed by the
+ * parent and the component name, so each step down is a single lookup.
+ */
+struct trigfiletree {
+	struct trigfiletree *next;
+	const struct trigfiletree *parent;
+	/* The node with the interests in this path, or NULL if none. */
+	struct filenamenode *fnn;
+	const char *name;
+	size_t len;
+	unsigned int hash;
+};
+
+static struct trigfiletree filetriggers_root;
+
+static struct {
+	struct trigfiletree **bins;
+	unsigned int nbins;
+	unsigned int nnodes;
+} filetriggers_tree;
+
+static unsigned int
+trig_file_tree_hash(const struct trigfiletree *parent, const char *name,
+                    size_t len)
+{
+	unsigned int h = (unsigned long)parent >> 4;
+
+	while (len--)
+		h = h * 33 + (unsigned char)*name++;
+
+	return h;
+}
+
+static void
+trig_file_tree_grow(void)
+{
+	struct trigfiletree **bins, *node, *next;
+	unsigned int nbins, i;
+
+	nbins = filetriggers_tree.nbins ? filetriggers_tree.nbins * 2 : 256;
+	bins = m_malloc(nbins * sizeof(*bins));
+	memset(bins, 0, nbins * sizeof(*bins));
+
+	for (i = 0; i < filetriggers_tree.nbins; i++) {
+		for (node = filetriggers_tree.bins[i]; node; node = next) {
+			next = node->next;
+			node->next = bins[node->hash % nbins];
+			bins[node->hash % nbins] = node;
+		}
+	}
+
+	free(filetriggers_tree.bins);
+	filetriggers_tree.bins = bins;
+	filetriggers_tree.nbins = nbins;
+}
+
+static struct trigfiletree *
+trig_file_tree_child(const struct trigfiletree *parent, const char *name,
+                     size_t len, bool create)
+{
+	struct trigfiletree *node;
+	unsigned int h;
+
+	if (!filetriggers_tree.nbins && !create)
+		return NULL;
+
+	h = trig_file_tree_hash(parent, name, len);
+	if (filetriggers_tree.nbins)
+		for (node = filetriggers_tree.bins[h % filetriggers_tree.nbins];
+		     node; node = node->next)
+			if (node->hash == h && node->parent == parent &&
+			    node->len == len && !memcmp(node->name, name, len))
+				return node;
+	if (!create)
+		return NULL;
+
+	if (filetriggers_tree.nnodes >= filetriggers_tree.nbins)
+		trig_file_tree_grow();
+
+	node = nfmalloc(sizeof(*node));
+	node->parent = parent;
+	node->fnn = NULL;
+	node->name = name;
+	node->len = len;
+	node->hash = h;
+	node->next = filetriggers_tree.bins[h % filetriggers_tree.nbins];
+	filetriggers_tree.bins[h % filetriggers_tree.nbins] = node;
+	filetriggers_tree.nnodes++;
+
+	return node;
+}
+
+static const char *
+trig_path_component(const char *path, size_t *len)
+{
+	while (*path == '/')
+		path++;
+	*len = strcspn(path, "/");
+
+	return path;
+}
+
+static void
+trig_file_tree_add(struct filenamenode *fnn)
+{
+	struct trigfiletree *node = &filetriggers_root;
+	const char *path = trigh.namenode_name(fnn);
+	size_t len;
+
+	for (path = trig_path_component(path, &len); len;
+	     path = trig_path_component(path + len, &len))
+		node = trig_file_tree_child(node, path, len, true);
+
+	node->fnn = fnn;
+}
+
+void
+trig_file_interests_match(const char *path, trig_file_interest_cb *cb,
+                          void *user)
+{
+	struct trigfileint *tfi;
+	struct trigfiletree *node = &filetriggers_root;
+	size_t len;
+
+	path = trig_path_component(path, &len);
+	for (;;) {
+		if (node->fnn)
+			for (tfi = *trigh.namenode_interested(node->fnn); tfi;
+			     tfi = tfi->samefile_next)
+				cb(tfi, user);
+
+		if (!len)
+			break;
+		node = trig_file_tree_child(node, path, len, false);
+		if (!node)
+			break;
+
+		path = trig_path_component(path + len, &len);
+	}
+}
+
 /* Called by various people with signum -1 and +1 to mean remove and add
  * and also by trig_file_interests_ensure with signum +2 meaning add
  * but die if already present.
@@ -459,6 +683,7 @@ trk_file_interest_change(const char *trig, struct pkginfo *pkg, int signum)
 	tfi->fnn = fnn;
 	tfi->samefile_next = *trigh.namenode_interested(fnn);
 	*trigh.namenode_interested(fnn) = tfi;
+	trig_file_tree_add(fnn);
 
 	LIST_LINK_TAIL_PART(filetriggers, tfi, inoverall.);
 	goto edited;
@@ -549,39 +774,39 @@ ok:
 	filetriggers_edited = 0;
 }
 
-static struct filenamenode *filetriggers_activating;
+static const char *filetriggers_activating;
+
+static void
+trig_file_activate_interest(struct trigfileint *tfi, void *user)
+{
+	struct pkginfo *aw = user;
+
+	trig_record_activation(tfi->pkg, aw, trigh.namenode_name(tfi->fnn));
+}
 
 void
 trig_file_activate_byname(const char *trig, struct pkginfo *aw)
 {
-	struct filenamenode *fnn = trigh.namenode_find(trig, 1);
-
-	if (fnn)
-		trig_file_activate(fnn, aw);
+	trig_file_interests_match(trig, trig_file_activate_interest, aw);
 }
 
 void
 trig_file_activate(struct filenamenode *trig, struct pkginfo *aw)
 {
-	struct trigfileint *tfi;
-
-	for (tfi = *trigh.namenode_interested(trig); tfi;
-	     tfi = tfi->samefile_next)
-		trig_record_activation(tfi->pkg, aw, trigh.namenode_name(trig));
+	trig_file_interests_match(trigh.namenode_name(trig),
+	                          trig_file_activate_interest, aw);
 }
 
 static void
 trk_file_activate_start(void)
 {
-	filetriggers_activating = trigh.namenode_find(trig_activating_name, 1);
+	filetriggers_activating = nfstrsave(trig_activating_name);
 }
 
 static void
 trk_file_activate_awaiter(struct pkginfo *aw)
 {
-	if (!filetriggers_activating)
-		return;
-	trig_file_activate(filetriggers_activating, aw);
+	trig_file_activate_byname(filetriggers_activating, aw);
 }
 
 static void
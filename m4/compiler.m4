@@ -106,3 +106,51 @@ AS_IF([test "x$dpkg_cv_c99" = "xyes"],
 	       [AC_MSG_ERROR([unsupported required C99 extensions])])])[]dnl
 ])# DPKG_C_C99
 
+
+# DPKG_C_SHA_INTRINSICS
+# ---------------------
+# Check whether the C compiler can build functions using the x86 SHA or
+# the ARMv8 SHA-2 instructions through a target attribute, so that they
+# can be selected at run time. Defines HAVE_X86_SHA_INTRINSICS and
+# HAVE_ARM_SHA2_INTRINSICS.
+AC_DEFUN([DPKG_C_SHA_INTRINSICS],
+[AC_CACHE_CHECK([whether compiler supports x86 SHA intrinsics],
+	[dpkg_cv_x86_sha_intrinsics],
+	[AC_COMPILE_IFELSE([AC_LANG_PROGRAM(
+		[[#include <cpuid.h>
+#include <immintrin.h>
+static __m128i __attribute__((target("sha,sse4.1,ssse3")))
+test_sha(__m128i a, __m128i b, __m128i c)
+{
+	a = _mm_sha256msg1_epu32(a, b);
+	return _mm_sha256rnds2_epu32(_mm_blend_epi16(a, b, 0xf0), b, c);
+}]],
+		[[unsigned int eax, ebx, ecx, edx;
+__cpuid_count(7, 0, eax, ebx, ecx, edx);
+__m128i x = _mm_set_epi32(eax, ebx, ecx, edx);
+return _mm_cvtsi128_si32(test_sha(x, x, x));]]
+	)],
+	[dpkg_cv_x86_sha_intrinsics=yes],
+	[dpkg_cv_x86_sha_intrinsics=no])])
+AS_IF([test "x$dpkg_cv_x86_sha_intrinsics" = "xyes"],
+	[AC_DEFINE([HAVE_X86_SHA_INTRINSICS], 1,
+		[Define to 1 if the x86 SHA intrinsics can be used])])
+AC_CACHE_CHECK([whether compiler supports ARMv8 SHA-2 intrinsics],
+	[dpkg_cv_arm_sha2_intrinsics],
+	[AC_COMPILE_IFELSE([AC_LANG_PROGRAM(
+		[[#include <sys/auxv.h>
+#include <arm_neon.h>
+static uint32x4_t __attribute__((target("+crypto")))
+test_sha(uint32x4_t a, uint32x4_t b, uint32x4_t c)
+{
+	return vsha256hq_u32(a, b, vsha256su0q_u32(c, b));
+}]],
+		[[uint32x4_t x = vdupq_n_u32(getauxval(AT_HWCAP));
+return vgetq_lane_u32(test_sha(x, x, x), 0);]]
+	)],
+	[dpkg_cv_arm_sha2_intrinsics=yes],
+	[dpkg_cv_arm_sha2_intrinsics=no])])
+AS_IF([test "x$dpkg_cv_arm_sha2_intrinsics" = "xyes"],
+	[AC_DEFINE([HAVE_ARM_SHA2_INTRINSICS], 1,
+		[Define to 1 if the ARMv8 SHA-2 intrinsics can be used])])dnl
+])# DPKG_C_SHA_INTRINSICS
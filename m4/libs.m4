@@ -88,6 +88,18 @@ if test "x$with_selinux" != "xno"; then
 fi
 ])# DPKG_LIB_SELINUX
 
+# DPKG_LIB_PTHREAD
+# ----------------
+# Check for POSIX threads library.
+AC_DEFUN([DPKG_LIB_PTHREAD],
+[AC_ARG_VAR([PTHREAD_LIBS], [linker flags for pthread library])dnl
+AC_CHECK_HEADER([pthread.h],
+	[AC_CHECK_LIB([pthread], [pthread_create],
+		[AC_DEFINE(WITH_PTHREAD, 1,
+			[Define to 1 to use POSIX threads])
+		 PTHREAD_LIBS="${PTHREAD_LIBS:+$PTHREAD_LIBS }-lpthread"])])
+])# DPKG_LIB_PTHREAD
+
 # DPKG_LIB_CURSES
 # ---------------
 # Check for curses library.
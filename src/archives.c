@@ -34,8 +34,13 @@
 #include <time.h>
 #include <ctype.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/time.h>
 #include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
 
 #include <obstack.h>
 #define obstack_chunk_alloc m_malloc
@@ -45,6 +50,7 @@
 #include <dpkg/dpkg-db.h>
 #include <dpkg/path.h>
 #include <dpkg/buffer.h>
+#include <dpkg/ioacct.h>
 #include <dpkg/subproc.h>
 #include <dpkg/tarfn.h>
 #include <dpkg/myopt.h>
@@ -237,20 +243,131 @@ does_replace(struct pkginfo *newpigp, struct pkginfoperfile *newpifp,
   return false;
 }
 
+static void
+fd_writeback_init(int fd)
+{
+#ifdef HAVE_SYNC_FILE_RANGE
+  /* Only a hint to the kernel to start the I/O, the file gets fsync'ed
+   * later on anyway, so the return code can be ignored.
+   */
+  sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+  ioacct_count(ioacct_other);
+#endif
+}
+
+/* New files whose data is being written back, kept open from tarobject
+ * until they are fsync'ed. Reopening them could fail, as they already
+ * have their final mode, which might not let us read or write them. The
+ * number kept open is bounded so that large packages do not run out of
+ * file descriptors.
+ */
+#define WRITEBACK_MAX_FILES 256
+
+struct writeback_file {
+  int fd;
+  struct filenamenode *namenode;
+};
+
+static struct writeback_file writeback_files[WRITEBACK_MAX_FILES];
+static int writeback_nfiles;
+
+/* Wait for the writeback started by fd_writeback_init on every pending
+ * file and fsync them, returning how many there were. Waiting for all of
+ * them in one pass before the fsyncs lets the kernel schedule the I/O
+ * as a whole instead of file by file.
+ */
+static int
+writeback_flush(void)
+{
+  struct writeback_file *wf;
+  int i, n, fd;
+
+#ifdef HAVE_SYNC_FILE_RANGE
+  for (i= 0; i < writeback_nfiles; i++) {
+    /* Ignore the return code, we are going to fsync anyway. */
+    sync_file_range(writeback_files[i].fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE);
+    ioacct_count(ioacct_other);
+  }
+#endif
+
+  for (i= 0; i < writeback_nfiles; i++) {
+    wf= &writeback_files[i];
+    debug(dbg_eachfiledetail, "deferred extract fsync `%s'", wf->namenode->name);
+    ioacct_count(ioacct_fsync);
+    if (fsync(wf->fd))
+      ohshite(_("unable to sync file '%.255s'"), wf->namenode->name);
+    /* Closed either way, so that cu_writeback does not close it again. */
+    fd= wf->fd;
+    wf->fd= -1;
+    if (close(fd))
+      ohshite(_("error closing/writing `%.255s'"), wf->namenode->name);
+  }
+
+  n= writeback_nfiles;
+  writeback_nfiles= 0;
+
+  return n;
+}
+
+static void
+writeback_add(int fd, struct filenamenode *namenode)
+{
+  writeback_files[writeback_nfiles].fd= fd;
+  writeback_files[writeback_nfiles].namenode= namenode;
+  writeback_nfiles++;
+
+  if (writeback_nfiles == WRITEBACK_MAX_FILES)
+    writeback_flush();
+}
+
+/* Closes the files still pending writeback when unpacking fails. */
+void
+cu_writeback(int argc, void **argv)
+{
+  int i;
+
+  for (i= 0; i < writeback_nfiles; i++)
+    if (writeback_files[i].fd >= 0)
+      close(writeback_files[i].fd);
+  writeback_nfiles= 0;
+}
+
+/* Files smaller than this fit in a few extents anyway, and are not
+ * worth the extra system call. */
+#define PREALLOCATE_MIN_SIZE (64 * 1024)
+
+static void
+fd_preallocate(int fd, off_t size)
+{
+  if (size < PREALLOCATE_MIN_SIZE)
+    return;
+
+  /* Only a hint to the filesystem to lay out the file in one go, if it
+   * cannot do that we just write the data as usual. Prefer fallocate, as
+   * posix_fallocate is emulated by writing every block on filesystems
+   * without native support, which would defeat the purpose.
+   */
+#if defined(HAVE_FALLOCATE)
+  fallocate(fd, 0, 0, size);
+#elif defined(HAVE_POSIX_FALLOCATE)
+  posix_fallocate(fd, 0, size);
+#endif
+}
+
 static void newtarobject_utime(const char *path, struct TarInfo *ti) {
   struct utimbuf utb;
   utb.actime= currenttime;
   utb.modtime= ti->ModTime;
-  if (utime(path,&utb))
+  if (dircache_utime(path,&utb))
     ohshite(_("error setting timestamps of `%.255s'"),ti->Name);
 }
 
 static void newtarobject_allmodes(const char *path, struct TarInfo *ti, struct filestatoverride* statoverride) {
-  if (chown(path,
+  if (dircache_chown(path,
 	    statoverride ? statoverride->uid : ti->UserID,
 	    statoverride ? statoverride->gid : ti->GroupID))
     ohshite(_("error setting ownership of `%.255s'"),ti->Name);
-  if (chmod(path,(statoverride ? statoverride->mode : ti->Mode) & ~S_IFMT))
+  if (dircache_chmod(path,(statoverride ? statoverride->mode : ti->Mode) & ~S_IFMT))
     ohshite(_("error setting permissions of `%.255s'"),ti->Name);
   newtarobject_utime(path,ti);
 }
@@ -278,7 +395,7 @@ int unlinkorrmdir(const char *filename) {
   /* Returns 0 on success or -1 on failure, just like unlink & rmdir */
   int r, e;
   
-  if (!rmdir(filename)) {
+  if (!dircache_rmdir(filename)) {
     debug(dbg_eachfiledetail,"unlinkorrmdir `%s' rmdir OK",filename);
     return 0;
   }
@@ -289,7 +406,7 @@ int unlinkorrmdir(const char *filename) {
     errno= e; return -1;
   }
   
-  r= unlink(filename); e= errno;
+  r= dircache_unlink(filename); e= errno;
   debug(dbg_eachfiledetail,"unlinkorrmdir `%s' unlink %s",
         filename, r ? strerror(e) : "OK");
   errno= e; return r;
@@ -315,7 +432,7 @@ linktosameexistingdir(const struct TarInfo *ti, const char *fname,
   int statr;
   const char *lastslash;
 
-  statr= stat(fname, &oldstab);
+  statr= dircache_stat(fname, &oldstab);
   if (statr) {
     if (!(errno == ENOENT || errno == ELOOP || errno == ENOTDIR))
       ohshite(_("failed to stat (dereference) existing symlink `%.250s'"),
@@ -338,6 +455,7 @@ linktosameexistingdir(const struct TarInfo *ti, const char *fname,
   varbufaddc(symlinkfn, 0);
 
   statr= stat(symlinkfn->buf, &newstab);
+  ioacct_count(ioacct_stat);
   if (statr) {
     if (!(errno == ENOENT || errno == ELOOP || errno == ENOTDIR))
       ohshite(_("failed to stat (dereference) proposed new symlink target"
@@ -356,7 +474,7 @@ int tarobject(struct TarInfo *ti) {
   static struct varbuf conffderefn, hardlinkfn, symlinkfn;
   static int fd;
   const char *usename;
-  struct filenamenode *usenode;
+  struct filenamenode *usenode, *linknode;
 
   struct conffile *conff;
   struct tarcontext *tc= (struct tarcontext*)ti->UserData;
@@ -423,7 +541,7 @@ int tarobject(struct TarInfo *ti) {
   
   setupfnamevbs(usename);
 
-  statr= lstat(fnamevb.buf,&stab);
+  statr= dircache_lstat(fnamevb.buf,&stab);
   if (statr) {
     /* The lstat failed. */
     if (errno != ENOENT && errno != ENOTDIR)
@@ -433,14 +551,14 @@ int tarobject(struct TarInfo *ti) {
      * backup/restore operation and were rudely interrupted.
      * So, we see if we have .dpkg-tmp, and if so we restore it.
      */
-    if (rename(fnametmpvb.buf,fnamevb.buf)) {
+    if (dircache_rename(fnametmpvb.buf,fnamevb.buf)) {
       if (errno != ENOENT && errno != ENOTDIR)
         ohshite(_("unable to clean up mess surrounding `%.255s' before "
                 "installing another version"),ti->Name);
       debug(dbg_eachfiledetail,"tarobject nonexistent");
     } else {
       debug(dbg_eachfiledetail,"tarobject restored tmp to main");
-      statr= lstat(fnamevb.buf,&stab);
+      statr= dircache_lstat(fnamevb.buf,&stab);
       if (statr) ohshite(_("unable to stat restored `%.255s' before installing"
                          " another version"), ti->Name);
     }
@@ -466,7 +584,7 @@ int tarobject(struct TarInfo *ti) {
     break;
   case Directory:
     /* If it's already an existing directory, do nothing. */
-    if (!stat(fnamevb.buf,&stabtmp) && S_ISDIR(stabtmp.st_mode)) {
+    if (!dircache_stat(fnamevb.buf,&stabtmp) && S_ISDIR(stabtmp.st_mode)) {
       debug(dbg_eachfiledetail,"tarobject Directory exists");
       existingdirectory= 1;
     }
@@ -522,6 +640,7 @@ int tarobject(struct TarInfo *ti) {
 	       conff= conff->next) {
 	    if (!conff->obsolete)
 	      continue;
+	    ioacct_count(ioacct_stat);
 	    if (stat(conff->name, &stabtmp))
 	      if (errno == ENOENT || errno == ENOTDIR || errno == ELOOP)
 		continue;
@@ -630,16 +749,20 @@ int tarobject(struct TarInfo *ti) {
     /* We create the file with mode 0 to make sure nobody can do anything with
      * it until we apply the proper mode, which might be a statoverride.
      */
-    fd= open(fnamenewvb.buf, (O_CREAT|O_EXCL|O_WRONLY), 0);
+    fd= dircache_open(fnamenewvb.buf, (O_CREAT|O_EXCL|O_WRONLY), 0);
     if (fd < 0)
       ohshite(_("unable to create `%.255s' (while processing `%.255s')"), fnamenewvb.buf, ti->Name);
     push_cleanup(cu_closefd, ehflag_bombout, NULL, 0, 1, &fd);
     debug(dbg_eachfiledetail,"tarobject NormalFile[01] open size=%lu",
           (unsigned long)ti->Size);
+    fd_preallocate(fd, ti->Size);
     { char fnamebuf[256];
-    fd_fd_copy(tc->backendpipe, fd, ti->Size,
-               _("backend dpkg-deb during `%.255s'"),
-               path_quote_filename(fnamebuf, ti->Name, 256));
+      char hash[MD5HASHLEN + 1];
+    fd_fd_copy_and_md5(tc->backendpipe, fd, hash, ti->Size,
+                       _("backend dpkg-deb during `%.255s'"),
+                       path_quote_filename(fnamebuf, ti->Name, 256));
+    nifd->namenode->newhash= nfstrsave(hash);
+    ioacct_written(ti->Size);
     }
     r= ti->Size % TARBLKSZ;
     if (r > 0) r= safe_read(tc->backendpipe,databuf,TARBLKSZ - r);
@@ -648,57 +771,72 @@ int tarobject(struct TarInfo *ti) {
 			  nifd->namenode->statoverride->uid,
 			  nifd->namenode->statoverride->gid,
 			  nifd->namenode->statoverride->mode);
+    ioacct_count(ioacct_other);
     if (fchown(fd,
 	    nifd->namenode->statoverride ? nifd->namenode->statoverride->uid : ti->UserID,
 	    nifd->namenode->statoverride ? nifd->namenode->statoverride->gid : ti->GroupID))
       ohshite(_("error setting ownership of `%.255s'"),ti->Name);
     am=(nifd->namenode->statoverride ? nifd->namenode->statoverride->mode : ti->Mode) & ~S_IFMT;
+    ioacct_count(ioacct_other);
     if (fchmod(fd,am))
       ohshite(_("error setting permissions of `%.255s'"),ti->Name);
     pop_cleanup(ehflag_normaltidy); /* fd= open(fnamenewvb.buf) */
-    if (close(fd))
+    /* Start writing the data back now, we will wait for it to hit the
+     * disk in one go just before the deferred renames.
+     */
+    if (!fc_unsafe_io) {
+      fd_writeback_init(fd);
+      writeback_add(fd, nifd->namenode);
+    } else if (close(fd)) {
       ohshite(_("error closing/writing `%.255s'"),ti->Name);
+    }
     newtarobject_utime(fnamenewvb.buf,ti);
     break;
   case FIFO:
-    if (mkfifo(fnamenewvb.buf,0))
+    if (dircache_mknod(fnamenewvb.buf,S_IFIFO,0))
       ohshite(_("error creating pipe `%.255s'"),ti->Name);
     debug(dbg_eachfiledetail,"tarobject FIFO");
     newtarobject_allmodes(fnamenewvb.buf,ti, nifd->namenode->statoverride);
     break;
   case CharacterDevice:
-    if (mknod(fnamenewvb.buf,S_IFCHR, ti->Device))
+    if (dircache_mknod(fnamenewvb.buf,S_IFCHR, ti->Device))
       ohshite(_("error creating device `%.255s'"),ti->Name);
     debug(dbg_eachfiledetail,"tarobject CharacterDevice");
     newtarobject_allmodes(fnamenewvb.buf,ti, nifd->namenode->statoverride);
     break; 
   case BlockDevice:
-    if (mknod(fnamenewvb.buf,S_IFBLK, ti->Device))
+    if (dircache_mknod(fnamenewvb.buf,S_IFBLK, ti->Device))
       ohshite(_("error creating device `%.255s'"),ti->Name);
     debug(dbg_eachfiledetail,"tarobject BlockDevice");
     newtarobject_allmodes(fnamenewvb.buf,ti, nifd->namenode->statoverride);
     break; 
   case HardLink:
     varbufreset(&hardlinkfn);
-    varbufaddstr(&hardlinkfn,instdir); varbufaddc(&hardlinkfn,'/');
-    varbufaddstr(&hardlinkfn,ti->LinkName); varbufaddc(&hardlinkfn,0);
-    if (link(hardlinkfn.buf,fnamenewvb.buf))
+    varbufaddstr(&hardlinkfn,instdir);
+    linknode= findnamenode(ti->LinkName, 0);
+    varbufaddstr(&hardlinkfn,namenodetouse(linknode,tc->pkg)->name);
+    /* The link target might not have been renamed into place yet. */
+    if (linknode->flags & fnnf_deferred_rename)
+      varbufaddstr(&hardlinkfn,DPKGNEWEXT);
+    varbufaddc(&hardlinkfn,0);
+    if (dircache_link(hardlinkfn.buf,fnamenewvb.buf))
       ohshite(_("error creating hard link `%.255s'"),ti->Name);
+    nifd->namenode->newhash= linknode->newhash;
     debug(dbg_eachfiledetail,"tarobject HardLink");
     newtarobject_allmodes(fnamenewvb.buf,ti, nifd->namenode->statoverride);
     break;
   case SymbolicLink:
     /* We've already cheched for an existing directory. */
-    if (symlink(ti->LinkName,fnamenewvb.buf))
+    if (dircache_symlink(ti->LinkName,fnamenewvb.buf))
       ohshite(_("error creating symbolic link `%.255s'"),ti->Name);
     debug(dbg_eachfiledetail,"tarobject SymbolicLink creating");
 #ifdef HAVE_LCHOWN
-    if (lchown(fnamenewvb.buf,
+    if (dircache_lchown(fnamenewvb.buf,
 	    nifd->namenode->statoverride ? nifd->namenode->statoverride->uid : ti->UserID,
 	    nifd->namenode->statoverride ? nifd->namenode->statoverride->gid : ti->GroupID))
       ohshite(_("error setting ownership of symlink `%.255s'"),ti->Name);
 #else
-    if (chown(fnamenewvb.buf,
+    if (dircache_chown(fnamenewvb.buf,
 	    nifd->namenode->statoverride ? nifd->namenode->statoverride->uid : ti->UserID,
 	    nifd->namenode->statoverride ? nifd->namenode->statoverride->gid : ti->GroupID))
       ohshite(_("error setting ownership of symlink `%.255s'"),ti->Name);
@@ -706,7 +844,7 @@ int tarobject(struct TarInfo *ti) {
     break;
   case Directory:
     /* We've already checked for an existing directory. */
-    if (mkdir(fnamenewvb.buf,0))
+    if (dircache_mkdir(fnamenewvb.buf,0))
       ohshite(_("error creating directory `%.255s'"),ti->Name);
     debug(dbg_eachfiledetail,"tarobject Directory creating");
     newtarobject_allmodes(fnamenewvb.buf,ti,nifd->namenode->statoverride);
@@ -741,7 +879,7 @@ int tarobject(struct TarInfo *ti) {
       /* One of the two is a directory - can't do atomic install. */
       debug(dbg_eachfiledetail,"tarobject directory, nonatomic");
       nifd->namenode->flags |= fnnf_no_atomic_overwrite;
-      if (rename(fnamevb.buf,fnametmpvb.buf))
+      if (dircache_rename(fnamevb.buf,fnametmpvb.buf))
         ohshite(_("unable to move aside `%.255s' to install new version"),ti->Name);
     } else if (S_ISLNK(stab.st_mode)) {
       /* We can't make a symlink with two hardlinks, so we'll have to copy it.
@@ -749,23 +887,23 @@ int tarobject(struct TarInfo *ti) {
        */
       varbufreset(&symlinkfn);
       varbuf_grow(&symlinkfn, stab.st_size + 1);
-      r = readlink(fnamevb.buf, symlinkfn.buf, symlinkfn.size);
+      r = dircache_readlink(fnamevb.buf, symlinkfn.buf, symlinkfn.size);
       if (r < 0)
         ohshite(_("unable to read link `%.255s'"), ti->Name);
       assert(r == stab.st_size);
       symlinkfn.used= r; varbufaddc(&symlinkfn,0);
-      if (symlink(symlinkfn.buf,fnametmpvb.buf))
+      if (dircache_symlink(symlinkfn.buf,fnametmpvb.buf))
         ohshite(_("unable to make backup symlink for `%.255s'"),ti->Name);
 #ifdef HAVE_LCHOWN
-      if (lchown(fnametmpvb.buf,stab.st_uid,stab.st_gid))
+      if (dircache_lchown(fnametmpvb.buf,stab.st_uid,stab.st_gid))
         ohshite(_("unable to chown backup symlink for `%.255s'"),ti->Name);
 #else
-      if (chown(fnametmpvb.buf,stab.st_uid,stab.st_gid))
+      if (dircache_chown(fnametmpvb.buf,stab.st_uid,stab.st_gid))
         ohshite(_("unable to chown backup symlink for `%.255s'"),ti->Name);
 #endif
     } else {
       debug(dbg_eachfiledetail,"tarobject nondirectory, `link' backup");
-      if (link(fnamevb.buf,fnametmpvb.buf))
+      if (dircache_link(fnamevb.buf,fnametmpvb.buf))
         ohshite(_("unable to make backup link of `%.255s' before installing new version"),
                 ti->Name);
     }
@@ -790,16 +928,31 @@ int tarobject(struct TarInfo *ti) {
         
 #endif /* WITH_SELINUX */
 
-  if (rename(fnamenewvb.buf,fnamevb.buf))
-    ohshite(_("unable to install new version of `%.255s'"),ti->Name);
+  if (ti->Type == Directory || (!statr && S_ISDIR(stab.st_mode))) {
+    /* Directories have to be in place for their contents to be
+     * extracted, so these cannot be deferred.
+     */
+    if (dircache_rename(fnamenewvb.buf,fnamevb.buf))
+      ohshite(_("unable to install new version of `%.255s'"),ti->Name);
 
-  /* CLEANUP: now the new file is in the destination file, and the
-   * old file is in dpkg-tmp to be cleaned up later.  We now need
-   * to take a different attitude to cleanup, because we need to
-   * remove the new file.
-   */
+    /* CLEANUP: now the new file is in the destination file, and the
+     * old file is in dpkg-tmp to be cleaned up later.  We now need
+     * to take a different attitude to cleanup, because we need to
+     * remove the new file.
+     */
 
-  nifd->namenode->flags |= fnnf_placed_on_disk;
+    nifd->namenode->flags |= fnnf_placed_on_disk;
+    nifd->namenode->flags |= fnnf_elide_other_lists;
+
+    debug(dbg_eachfiledetail,"tarobject done and installed");
+  } else {
+    /* The rename is done by tar_deferred_extract, once the data of all
+     * the files has been written back to disk.
+     */
+    nifd->namenode->flags |= fnnf_deferred_rename;
+
+    debug(dbg_eachfiledetail,"tarobject done and installation deferred");
+  }
 
 #ifdef WITH_SELINUX
   /*
@@ -810,11 +963,56 @@ int tarobject(struct TarInfo *ti) {
       perror("Error restoring default security context:");
 #endif /* WITH_SELINUX */
 
+  return 0;
+}
+
+/* Make all the files extracted by tarobject durable, and then rename
+ * them into place, so that a crash can never leave a half written file
+ * under its real name.
+ */
+void
+tar_deferred_extract(struct fileinlist *files, struct pkginfo *pkg)
+{
+  struct fileinlist *cfile;
+  struct filenamenode *usenode;
+  struct timeval start, end;
+  int nsynced;
+  long waited;
+
+  gettimeofday(&start, NULL);
 
-  nifd->namenode->flags |= fnnf_elide_other_lists;
+  nsynced= writeback_flush();
 
-  debug(dbg_eachfiledetail,"tarobject done and installed");
-  return 0;
+  gettimeofday(&end, NULL);
+  waited= (end.tv_sec - start.tv_sec) * 1000000L +
+          (end.tv_usec - start.tv_usec);
+  debug(dbg_general, "deferred extract waited %ld.%06lds for writeback of %d files",
+        waited / 1000000L, waited % 1000000L, nsynced);
+
+  for (cfile= files; cfile; cfile= cfile->next) {
+    if (!(cfile->namenode->flags & fnnf_deferred_rename))
+      continue;
+
+    usenode= namenodetouse(cfile->namenode, pkg);
+    setupfnamevbs(usenode->name + 1);
+
+    debug(dbg_eachfiledetail, "deferred extract rename `%s'", fnamevb.buf);
+
+    if (dircache_rename(fnamenewvb.buf,fnamevb.buf))
+      ohshite(_("unable to install new version of `%.255s'"),
+              cfile->namenode->name);
+
+    cfile->namenode->flags &= ~fnnf_deferred_rename;
+
+    /* CLEANUP: now the new file is in the destination file, and the
+     * old file is in dpkg-tmp to be cleaned up later.  We now need
+     * to take a different attitude to cleanup, because we need to
+     * remove the new file.
+     */
+
+    cfile->namenode->flags |= fnnf_placed_on_disk;
+    cfile->namenode->flags |= fnnf_elide_other_lists;
+  }
 }
 
 static int
@@ -1046,7 +1244,208 @@ void cu_cidir(int argc, void **argv) {
 
 void cu_fileslist(int argc, void **argv) {
   destroyobstack();
-}  
+}
+
+/* While one archive is being installed, the filesystem tarball of the
+ * next one is decompressed by a background dpkg-deb into an unlinked
+ * spool file, which process_archive then reads instead of running the
+ * backend itself. Nothing is installed from the spool out of order;
+ * the prefetch only moves the decompression off the critical path.
+ */
+
+#define PREFETCH_SLOTS 2
+#define PREFETCH_SPOOL_MAX (128 * 1024 * 1024)
+/* Left free on top of what the spools could take, for the packages
+ * being installed and the database. */
+#define PREFETCH_SPOOL_RESERVE (256 * 1024 * 1024)
+
+struct archive_prefetch {
+  const char *filename;
+  struct stat stab;
+  pid_t pid;
+  int fd;
+  unsigned long seq;
+};
+
+static struct archive_prefetch prefetch[PREFETCH_SLOTS];
+static unsigned long prefetch_seq, prefetch_started, prefetch_used;
+
+static void
+archive_prefetch_discard(struct archive_prefetch *ap)
+{
+  int status;
+
+  if (ap->pid > 0) {
+    /* The whole group, so that the ar copy and the decompressor run by
+     * dpkg-deb stop filling the spool too. */
+    kill(-ap->pid, SIGTERM);
+    while (waitpid(ap->pid, &status, 0) < 0 && errno == EINTR) ;
+  }
+  close(ap->fd);
+  ap->filename = NULL;
+  ap->pid = -1;
+  ap->fd = -1;
+}
+
+static void
+archive_prefetch_child(void *data)
+{
+  struct rlimit rlim;
+
+  /* Archives that do not fit are not worth spooling, they will be
+   * read from the backend pipe as usual. */
+  rlim.rlim_cur = rlim.rlim_max = PREFETCH_SPOOL_MAX;
+  setrlimit(RLIMIT_FSIZE, &rlim);
+  /* In a process group of its own, so that it can be stopped with all
+   * of its children. */
+  setpgid(0, 0);
+  signal(SIGXFSZ, SIG_DFL);
+  setpriority(PRIO_PROCESS, 0, 10);
+}
+
+/* Whether the filesystem holding the spools can take every slot filling
+ * up, without running the installation itself out of space. */
+static bool
+archive_prefetch_space(void)
+{
+  struct statvfs svfs;
+  unsigned long long avail;
+
+  if (statvfs(admindir, &svfs)) {
+    debug(dbg_general, "archive prefetch cannot statvfs `%s': %s",
+          admindir, strerror(errno));
+    return false;
+  }
+  avail = (unsigned long long)svfs.f_bavail * svfs.f_frsize;
+  if (avail < (unsigned long long)PREFETCH_SLOTS * PREFETCH_SPOOL_MAX +
+              PREFETCH_SPOOL_RESERVE) {
+    debug(dbg_general, "archive prefetch skipped, only %llu bytes free "
+          "in `%s'", avail, admindir);
+    return false;
+  }
+
+  return true;
+}
+
+static void
+archive_prefetch_start(const char *filename)
+{
+  static struct varbuf spoolfn;
+  struct subproc_spawn sp = SUBPROC_SPAWN_INIT;
+  const char *args[] = { BACKEND, "--fsys-tarfile", filename, NULL };
+  struct archive_prefetch *ap, *victim;
+  struct stat stab;
+  int fd, devnull, i;
+
+  if (!filename || f_noact)
+    return;
+  if (stat(filename, &stab) || !S_ISREG(stab.st_mode) ||
+      stab.st_size > PREFETCH_SPOOL_MAX)
+    return;
+
+  victim = NULL;
+  for (i = 0; i < PREFETCH_SLOTS; i++) {
+    ap = &prefetch[i];
+    if (ap->filename && strcmp(ap->filename, filename) == 0)
+      return;
+    if (!victim || !ap->filename ||
+        (victim->filename && ap->seq < victim->seq))
+      victim = ap;
+  }
+  if (victim->filename)
+    archive_prefetch_discard(victim);
+
+  varbufreset(&spoolfn);
+  varbufaddstr(&spoolfn, admindir);
+  varbufaddstr(&spoolfn, "/tmp.prefetch");
+  varbufaddc(&spoolfn, 0);
+
+  if (!archive_prefetch_space())
+    return;
+
+  unlink(spoolfn.buf);
+  fd = open(spoolfn.buf, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    debug(dbg_general, "archive prefetch cannot create spool: %s",
+          strerror(errno));
+    return;
+  }
+  unlink(spoolfn.buf);
+  setcloexec(fd, spoolfn.buf);
+
+  victim->filename = filename;
+  victim->stab = stab;
+  victim->fd = fd;
+  victim->seq = ++prefetch_seq;
+  devnull = open("/dev/null", O_WRONLY);
+  if (devnull >= 0)
+    setcloexec(devnull, "/dev/null");
+  /* Errors are reported when the archive is processed for real. */
+  sp.fd[1] = fd;
+  sp.fd[2] = devnull;
+  sp.setup = archive_prefetch_child;
+  victim->pid = subproc_spawn(BACKEND " --fsys-tarfile", BACKEND, args, &sp);
+  /* Also from here, in case we did not have to wait for the child to
+   * run its setup, it fails harmlessly once the program is running. */
+  setpgid(victim->pid, victim->pid);
+  if (devnull >= 0)
+    close(devnull);
+  prefetch_started++;
+
+  debug(dbg_general, "archive prefetch of `%s' started", filename);
+}
+
+/* Return an fd with the filesystem tarball of filename, if it has been
+ * prefetched completely and the archive has not changed since, or -1.
+ */
+int
+archive_prefetch_take(const char *filename)
+{
+  struct archive_prefetch *ap;
+  struct stat stab;
+  pid_t r;
+  int status, fd, i;
+
+  for (i = 0; i < PREFETCH_SLOTS; i++) {
+    ap = &prefetch[i];
+    if (ap->filename && strcmp(ap->filename, filename) == 0)
+      break;
+  }
+  if (i == PREFETCH_SLOTS)
+    return -1;
+
+  while ((r = waitpid(ap->pid, &status, 0)) < 0 && errno == EINTR) ;
+  ap->pid = -1;
+
+  if (r < 0 || !WIFEXITED(status) || WEXITSTATUS(status) ||
+      stat(filename, &stab) ||
+      stab.st_dev != ap->stab.st_dev || stab.st_ino != ap->stab.st_ino ||
+      stab.st_size != ap->stab.st_size || stab.st_mtime != ap->stab.st_mtime ||
+      lseek(ap->fd, 0, SEEK_SET) < 0) {
+    debug(dbg_general, "archive prefetch of `%s' not usable", filename);
+    archive_prefetch_discard(ap);
+    return -1;
+  }
+
+  fd = ap->fd;
+  ap->filename = NULL;
+  ap->fd = -1;
+  prefetch_used++;
+
+  debug(dbg_general, "archive prefetch of `%s' used", filename);
+
+  return fd;
+}
+
+static void
+archive_prefetch_cancel(void)
+{
+  int i;
+
+  for (i = 0; i < PREFETCH_SLOTS; i++)
+    if (prefetch[i].filename)
+      archive_prefetch_discard(&prefetch[i]);
+}
 
 void archivefiles(const char *const *argv) {
   const char *volatile thisarg;
@@ -1056,15 +1455,18 @@ void archivefiles(const char *const *argv) {
   FILE *pf;
   static struct varbuf findoutput;
   const char **arglist;
+  struct tar_name_cache_stats name_cache_stats;
+  struct buffer_copy_stats copy_stats;
   char *p;
 
   trigproc_install_hooks();
 
   modstatdb_init(admindir,
-                 f_noact ?                     msdbrw_readonly
-               : cipaction->arg == act_avail ? msdbrw_write
-               : fc_nonroot ?                  msdbrw_write
-               :                               msdbrw_needsuperuser);
+                 (f_noact ?                     msdbrw_readonly
+                : cipaction->arg == act_avail ? msdbrw_write
+                : fc_nonroot ?                  msdbrw_write
+                :                               msdbrw_needsuperuser) |
+                 (fc_unsafe_io ? msdbrw_unsafe_io : 0));
 
   checkpath();
   log_message("startup archives %s", cipaction->olong);
@@ -1075,10 +1477,10 @@ void archivefiles(const char *const *argv) {
       badusage(_("--%s --recursive needs at least one path argument"),cipaction->olong);
     
     m_pipe(pi);
-    if (!(fc= m_fork())) {
+    {
+      struct subproc_spawn sp = SUBPROC_SPAWN_INIT;
       const char *const *ap;
       int i;
-      m_dup2(pi[1],1); close(pi[0]); close(pi[1]);
       for (i=0, ap=argv; *ap; ap++, i++);
       arglist = m_malloc(sizeof(char *) * (i + 15));
       arglist[0] = FIND;
@@ -1103,8 +1505,15 @@ void archivefiles(const char *const *argv) {
       arglist[i++] = "f";
       arglist[i++] = "-print0";
       arglist[i++] = NULL;
-      execvp(FIND, (char *const *)arglist);
-      ohshite(_("failed to exec find for --recursive"));
+
+      setcloexec(pi[0], _("<find pipe>"));
+      sp.fd[1]= pi[1];
+      fc= subproc_spawn("find", FIND, arglist, &sp);
+
+      for (i=1, ap=argv; *ap; ap++, i++)
+        if (arglist[i] != *ap)
+          free((char *)arglist[i]);
+      free(arglist);
     }
     close(pi[1]);
 
@@ -1162,12 +1571,16 @@ void archivefiles(const char *const *argv) {
   
   while ((thisarg = *argp++) != NULL) {
     if (setjmp(ejbuf)) {
+      /* The cleanups do not go through the directory cache. */
+      dircache_stop();
       error_unwind(ehflag_bombout);
       if (abort_processing)
         break;
       continue;
     }
     push_error_handler(&ejbuf,print_error_perpackage,thisarg);
+    archive_prefetch_start(*argp);
+    ioacct_subject(NULL);
     process_archive(thisarg);
     onerr_abort++;
     m_output(stdout, _("<standard output>"));
@@ -1177,6 +1590,22 @@ void archivefiles(const char *const *argv) {
     error_unwind(ehflag_normaltidy);
   }
 
+  archive_prefetch_cancel();
+  debug(dbg_general, "archivefiles prefetched %lu archives, used %lu",
+        prefetch_started, prefetch_used);
+  depcache_report();
+
+  tar_name_cache_get_stats(&name_cache_stats);
+  debug(dbg_general, "archivefiles tar user/group name cache %lu hits of %lu lookups",
+        name_cache_stats.hits, name_cache_stats.lookups);
+  buffer_copy_get_stats(&copy_stats);
+  debug(dbg_general, "archivefiles copied %lu bytes in %lu copies (%lu zero-copy) "
+        "at %.1f MiB/s",
+        (unsigned long)copy_stats.bytes, copy_stats.copies,
+        copy_stats.zerocopy_copies,
+        copy_stats.seconds > 0 ?
+        copy_stats.bytes / copy_stats.seconds / (1024 * 1024) : 0.0);
+
   switch (cipaction->arg) {
   case act_install:
   case act_configure:
@@ -1193,6 +1622,7 @@ void archivefiles(const char *const *argv) {
 
   trigproc_run_deferred();
   modstatdb_shutdown();
+  sync_unsafe_io();
 }
 
 int wanttoinstall(struct pkginfo *pkg, const struct versionrevision *ver, int saywhy) {
@@ -62,10 +62,15 @@ void cu_postrmupgrade(int argc, void **argv);
 void cu_prermdeconfigure(int argc, void **argv);
 void ok_prermdeconfigure(int argc, void **argv);
 
+int archive_prefetch_take(const char *filename);
+
 void setupfnamevbs(const char *filename);
 int unlinkorrmdir(const char *filename);
 
+void cu_writeback(int argc, void **argv);
+
 int tarobject(struct TarInfo *ti);
+void tar_deferred_extract(struct fileinlist *files, struct pkginfo *pkg);
 int tarfileread(void *ud, char *buf, int len);
 
 bool filesavespackage(struct fileinlist *, struct pkginfo *,
@@ -0,0 +1,328 @@
+#!/bin/sh
+#
+# dpkg - main program for package management
+# b-dpkg.sh - end to end benchmark on a synthetic package set
+#
+# This is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as
+# published by the Free Software Foundation; either version 2,
+# or (at your option) any later version.
+#
+# This is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public
+# License along with dpkg; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+# Usage:
+#   b-dpkg.sh                  run the whole benchmark in a temporary dir
+#   b-dpkg.sh debs <dir>       only generate the package trees and .debs
+#   b-dpkg.sh admindir <dir>   only generate a synthetic admindir
+#
+# The package set is a function of the following variables only, so
+# that runs on different trees can be compared:
+#
+#   BENCH_PACKAGES   number of packages (default 200)
+#   BENCH_FILES      files per package (default 20)
+#   BENCH_DEPENDS    average number of dependencies per package (default 2)
+#   BENCH_TRIGGERS   packages with a file trigger interest (default 4)
+#   BENCH_CONFFILES  conffiles per package (default 1)
+#   BENCH_SEED       seed for the dependency graph (default 1)
+#
+# DPKG, DPKG_DEB and DPKG_QUERY select the programs to measure, and
+# default to the ones found in PATH. Every result is printed on its own
+# line as "<operation> <seconds>", after a "#" line with the parameters.
+
+set -e
+
+: ${BENCH_PACKAGES:=200}
+: ${BENCH_FILES:=20}
+: ${BENCH_DEPENDS:=2}
+: ${BENCH_TRIGGERS:=4}
+: ${BENCH_CONFFILES:=1}
+: ${BENCH_SEED:=1}
+
+: ${DPKG:=dpkg}
+: ${DPKG_DEB:=dpkg-deb}
+: ${DPKG_QUERY:=dpkg-query}
+
+# Prints the synthetic package set in a line based format that the
+# generators below turn into files:
+#
+#   P <name> <depends>      a new package, depends comma separated or "-"
+#   F <name> <path>         a plain file shipped by the package
+#   C <name> <path>         a conffile shipped by the package
+#   T <name> <path>         a file trigger interest of the package
+bench_plan()
+{
+	awk -v n="$BENCH_PACKAGES" -v m="$BENCH_FILES" \
+	    -v deps="$BENCH_DEPENDS" -v trig="$BENCH_TRIGGERS" \
+	    -v conf="$BENCH_CONFFILES" -v seed="$BENCH_SEED" '
+	function name(i) {
+		return sprintf("bench-%05d", i)
+	}
+	BEGIN {
+		srand(seed)
+		for (i = 0; i < n; i++) {
+			# Only depend on packages with a lower number, so
+			# that the graph has no cycles.
+			d = ""
+			for (j = 0; i > 0 && j < 2 * deps; j++) {
+				if (rand() < 0.5)
+					continue
+				k = int(rand() * i)
+				if (index("," d ",", "," name(k) ","))
+					continue
+				d = d (d == "" ? "" : ",") name(k)
+			}
+			print "P", name(i), (d == "" ? "-" : d)
+
+			if (i < trig)
+				print "T", name(i), "/usr/share/bench/trig" i
+			for (f = 0; f < m; f++) {
+				if (f == 0 && trig > 0)
+					path = "/usr/share/bench/trig" (i % trig) "/" name(i)
+				else
+					path = "/usr/share/bench/" name(i) "/file" f
+				print "F", name(i), path
+			}
+			for (c = 0; c < conf; c++)
+				print "C", name(i), "/etc/bench/" name(i) "/conf" c
+		}
+	}'
+}
+
+# Creates one tree per package under <dir>/src.
+bench_trees()
+{
+	dir=$1
+
+	rm -rf "$dir/src"
+	mkdir -p "$dir/src"
+
+	bench_plan | awk -v dir="$dir/src" '
+	function flush() {
+		if (pkg == "")
+			return
+		system("mkdir -p" dirs)
+		for (p in content) {
+			print content[p] > p
+			close(p)
+		}
+		delete content
+		dirs = ""
+	}
+	function add(path) {
+		sub("/[^/]*$", "", path)
+		dirs = dirs " \"" path "\""
+	}
+	function append(file, line) {
+		if (file in content)
+			line = content[file] "\n" line
+		content[file] = line
+	}
+	$1 == "P" {
+		flush()
+		pkg = $2
+		root = dir "/" pkg
+		ctl = root "/DEBIAN/control"
+		dirs = " \"" root "/DEBIAN\""
+		content[ctl] = "Package: " pkg "\nVersion: 1.0\n" \
+		               "Architecture: all\nMaintainer: bench <bench@localhost>\n" \
+		               "Description: synthetic benchmark package"
+		if ($3 != "-") {
+			gsub(",", ", ", $3)
+			content[ctl] = content[ctl] "\nDepends: " $3
+		}
+		next
+	}
+	$1 == "F" || $1 == "C" {
+		add(root $3)
+		content[root $3] = pkg " " $3
+	}
+	$1 == "C" {
+		append(root "/DEBIAN/conffiles", $3)
+	}
+	$1 == "T" {
+		append(root "/DEBIAN/triggers", "interest " $3)
+	}
+	END {
+		flush()
+	}'
+}
+
+# Builds the trees into <dir>/debs.
+bench_build()
+{
+	dir=$1
+
+	rm -rf "$dir/debs"
+	mkdir -p "$dir/debs"
+
+	for src in "$dir"/src/*; do
+		"$DPKG_DEB" -b "$src" "$dir/debs/${src##*/}.deb"
+	done
+}
+
+# Extracts the .debs from <dir>/debs into <dir>/extract.
+bench_extract()
+{
+	dir=$1
+
+	rm -rf "$dir/extract"
+	for deb in "$dir"/debs/*.deb; do
+		"$DPKG_DEB" -x "$deb" "$dir/extract"
+	done
+}
+
+# Writes a status file and file lists for the whole package set as if
+# it had been installed, without creating any of the files, to time the
+# queries on a database of the requested size.
+bench_admindir()
+{
+	dir=$1
+
+	rm -rf "$dir"
+	mkdir -p "$dir/info" "$dir/updates" "$dir/triggers"
+	: >"$dir/available"
+
+	bench_plan | awk -v dir="$dir" '
+	function flush() {
+		if (pkg == "")
+			return
+		print "Package: " pkg > status
+		print "Status: install ok installed" > status
+		print "Version: 1.0" > status
+		print "Architecture: all" > status
+		print "Maintainer: bench <bench@localhost>" > status
+		if (deps != "-")
+			print "Depends: " deps > status
+		if (conffiles != "")
+			print "Conffiles:" conffiles > status
+		print "Description: synthetic benchmark package\n" > status
+
+		list = dir "/info/" pkg ".list"
+		for (d in dirs)
+			print d > list
+		close(list)
+		delete dirs
+		conffiles = ""
+	}
+	function add(path) {
+		list = dir "/info/" pkg ".list"
+		print path > list
+		while (sub("/[^/]*$", "", path) && path != "")
+			dirs[path] = 1
+	}
+	BEGIN {
+		status = dir "/status"
+	}
+	$1 == "P" {
+		flush()
+		pkg = $2
+		deps = $3
+		gsub(",", ", ", deps)
+		next
+	}
+	$1 == "F" {
+		add($3)
+	}
+	$1 == "C" {
+		add($3)
+		conffiles = conffiles "\n " $3 " 00000000000000000000000000000000"
+	}
+	END {
+		flush()
+	}'
+}
+
+# Creates an empty root directory with an empty database in it.
+bench_root()
+{
+	rm -rf "$1"
+	mkdir -p "$1/var/lib/dpkg/info" "$1/var/lib/dpkg/updates" \
+	         "$1/var/lib/dpkg/triggers"
+	: >"$1/var/lib/dpkg/status"
+	: >"$1/var/lib/dpkg/available"
+}
+
+bench_now()
+{
+	date +%s.%N
+}
+
+# Runs the command or shell function with its output discarded, and
+# prints how long it took under the given operation name.
+bench_time()
+{
+	op=$1
+	shift
+
+	start=$(bench_now)
+	"$@" >/dev/null
+	end=$(bench_now)
+
+	awk -v op="$op" -v start="$start" -v end="$end" \
+	    'BEGIN { printf("%-18s %10.6f\n", op, end - start) }'
+}
+
+bench_run()
+{
+	tmp=$(mktemp -d "${TMPDIR:-/tmp}/b-dpkg.XXXXXX")
+	trap 'rm -rf "$tmp"' EXIT
+
+	echo "# packages=$BENCH_PACKAGES files=$BENCH_FILES" \
+	     "depends=$BENCH_DEPENDS triggers=$BENCH_TRIGGERS" \
+	     "conffiles=$BENCH_CONFFILES seed=$BENCH_SEED"
+
+	bench_trees "$tmp"
+	bench_time dpkg-deb-build bench_build "$tmp"
+	bench_time dpkg-deb-extract bench_extract "$tmp"
+
+	root=$tmp/root
+	admindir=$root/var/lib/dpkg
+	opts="--root=$root --admindir=$admindir --force-not-root --force-bad-path"
+	debs=$(ls "$tmp"/debs/*.deb)
+	pkgs=$(ls "$tmp/src")
+	# The first package is left installed, as it owns the root directory
+	# like base-files would on a real system.
+	rmpkgs=$(ls "$tmp/src" | sed 1d)
+
+	bench_root "$root"
+	bench_time dpkg-unpack $DPKG $opts --unpack $debs
+	bench_time dpkg-configure $DPKG $opts --configure -a
+	bench_time dpkg-remove $DPKG $opts --remove $rmpkgs
+	bench_time dpkg-purge $DPKG $opts --purge $rmpkgs
+
+	bench_root "$root"
+	bench_time dpkg-install $DPKG $opts --install $debs
+
+	bench_admindir "$tmp/admindir"
+	opts="--admindir=$tmp/admindir"
+	last=$(ls "$tmp/src" | tail -n 1)
+
+	bench_time dpkg-query-list $DPKG_QUERY $opts -l
+	bench_time dpkg-query-files $DPKG_QUERY $opts -L $pkgs
+	bench_time dpkg-query-search $DPKG_QUERY $opts \
+	    -S "/usr/share/bench/$last/file$((BENCH_FILES - 1))"
+}
+
+case $1 in
+debs)
+	bench_trees "$2"
+	bench_build "$2" >/dev/null
+	;;
+admindir)
+	bench_admindir "$2"
+	;;
+'')
+	bench_run
+	;;
+*)
+	echo "usage: $0 [debs <dir> | admindir <dir>]" >&2
+	exit 1
+	;;
+esac
@@ -46,8 +46,10 @@
 #include <dpkg/macros.h>
 #include <dpkg/dpkg.h>
 #include <dpkg/dpkg-db.h>
+#include <dpkg/ioacct.h>
 #include <dpkg/buffer.h>
 #include <dpkg/file.h>
+#include <dpkg/subproc.h>
 
 #include "filesdb.h"
 #include "main.h"
@@ -69,7 +71,7 @@ static enum conffopt promptconfaction(const char *cfgfile,
 static void
 deferred_configure_conffile(struct pkginfo *pkg, struct conffile *conff)
 {
-	struct filenamenode *usenode;
+	struct filenamenode *namenode, *usenode;
 	static const char EMPTY_HASH[] = "-";
 	char currenthash[MD5HASHLEN + 1], newdisthash[MD5HASHLEN + 1];
 	int useredited, distedited;
@@ -79,7 +81,8 @@ deferred_configure_conffile(struct pkginfo *pkg, struct conffile *conff)
 	char *cdr2rest;
 	int r;
 
-	usenode = namenodetouse(findnamenode(conff->name, fnn_nocopy), pkg);
+	namenode = findnamenode(conff->name, fnn_nocopy);
+	usenode = namenodetouse(namenode, pkg);
 
 	r = conffderef(pkg, &cdr, usenode->name);
 	if (r == -1) {
@@ -103,7 +106,12 @@ deferred_configure_conffile(struct pkginfo *pkg, struct conffile *conff)
 			return;
 		ohshite(_("unable to stat new dist conffile `%.250s'"), cdr2.buf);
 	}
-	md5hash(pkg, newdisthash, cdr2.buf);
+	/* The digest of the new dist version was recorded while unpacking,
+	 * only read the file back if it was not. */
+	if (namenode->newhash)
+		strcpy(newdisthash, namenode->newhash);
+	else
+		md5hash(pkg, newdisthash, cdr2.buf);
 
 	/* Copy the permissions from the installed version to the new
 	 * distributed version. */
@@ -211,6 +219,160 @@ deferred_configure_conffile(struct pkginfo *pkg, struct conffile *conff)
 	varbuffree(&cdr2);
 }
 
+/*
+ * With --jobs, the postinst of a package is started and left running
+ * while the queue moves on. Its dependers see it as still being
+ * configured, so they wait for it the same way they would wait for
+ * any other package in the queue; the package is only marked as
+ * installed, and the triggers its postinst activated incorporated, once
+ * the script has finished.
+ */
+
+struct configure_job {
+	struct pkginfo *pkg;
+	pid_t pid;
+	struct timespan span;
+};
+
+static struct configure_job *configure_jobs;
+static int configure_njobs;
+
+bool
+configure_jobs_running(void)
+{
+	return configure_njobs > 0;
+}
+
+static void
+configure_job_done(struct pkginfo *pkg, int status)
+{
+	jmp_buf ejbuf;
+
+	debug(dbg_general, "configure_job_done %s status %d, %d running",
+	      pkg->name, status, configure_njobs);
+
+	if (setjmp(ejbuf)) {
+		pkg->clientdata->istobe = itb_normal;
+		error_unwind(ehflag_bombout);
+		return;
+	}
+	push_error_handler(&ejbuf, print_error_perpackage, pkg->name);
+
+	maintainer_script_postinst_done(pkg, status);
+
+	pkg->eflag = eflag_ok;
+	post_postinst_tasks(pkg, stat_installed);
+
+	m_output(stdout, _("<standard output>"));
+	m_output(stderr, _("<standard error>"));
+	set_error_display(NULL, NULL);
+	error_unwind(ehflag_normaltidy);
+}
+
+/*
+ * Reap a finished postinst, and with all, every one still running, and
+ * finish configuring their packages.
+ */
+void
+configure_jobs_wait(bool all)
+{
+	const char *desc = _("installed post-installation script");
+	const char *subject;
+	siginfo_t info;
+	pid_t pid;
+	int i, status;
+
+	if (!configure_njobs)
+		return;
+
+	setup_subproc_signals(desc);
+
+	while (configure_njobs) {
+		/* Find out which script finished first without reaping it,
+		 * as it might not be one of ours. */
+		info.si_pid = 0;
+		while (waitid(P_ALL, 0, &info, WEXITED | WNOWAIT) == -1 &&
+		       errno == EINTR)
+			;
+		for (i = 0; i < configure_njobs; i++)
+			if (configure_jobs[i].pid == info.si_pid)
+				break;
+		if (i == configure_njobs)
+			i = 0;
+
+		while ((pid = waitpid(configure_jobs[i].pid, &status, 0)) == -1 &&
+		       errno == EINTR)
+			;
+		if (pid != configure_jobs[i].pid) {
+			onerr_abort++;
+			ohshite(_("wait for %s failed"), desc);
+		}
+
+		timespan_end(&configure_jobs[i].span);
+		subject = ioacct_subject(configure_jobs[i].pkg->name);
+		configure_job_done(configure_jobs[i].pkg, status);
+		ioacct_subject(subject);
+		configure_jobs[i] = configure_jobs[--configure_njobs];
+
+		if (!all)
+			break;
+	}
+
+	pop_cleanup(ehflag_normaltidy);
+}
+
+/*
+ * Whether postinst scripts can be run concurrently. They inherit our
+ * standard input and output, so when a user might be asked something
+ * they are run one at a time.
+ */
+static bool
+configure_jobs_parallel(void)
+{
+	static int parallel = -1;
+
+	if (parallel < 0) {
+		parallel = f_jobs > 1 && !isatty(0);
+		if (f_jobs > 1 && !parallel)
+			debug(dbg_general, "configure_jobs standard input is a "
+			      "terminal, running postinst scripts serially");
+	}
+
+	return parallel;
+}
+
+static void
+configure_job_start(struct pkginfo *pkg)
+{
+	struct timespan span;
+	pid_t pid;
+
+	if (!configure_jobs)
+		configure_jobs = m_malloc(f_jobs * sizeof(*configure_jobs));
+	if (configure_njobs >= f_jobs)
+		configure_jobs_wait(false);
+
+	timespan_start(&span, POSTINSTFILE, pkg->name);
+	pid = maintainer_script_postinst_start(pkg, "configure",
+	                                       informativeversion(&pkg->configversion) ?
+	                                       versiondescribe(&pkg->configversion,
+	                                                       vdew_nonambig) : "",
+	                                       NULL);
+	if (!pid) {
+		pkg->eflag = eflag_ok;
+		post_postinst_tasks(pkg, stat_installed);
+		return;
+	}
+
+	configure_jobs[configure_njobs].pkg = pkg;
+	configure_jobs[configure_njobs].pid = pid;
+	configure_jobs[configure_njobs].span = span;
+	configure_njobs++;
+
+	debug(dbg_general, "configure_job_start %s pid %d, %d running",
+	      pkg->name, (int)pid, configure_njobs);
+}
+
 /*
  * The algorithm for deciding what to configure first is as follows:
  * Loop through all packages doing a ‘try 1’ until we've been round
@@ -263,6 +425,12 @@ deferred_configure(struct pkginfo *pkg)
 		varbuffree(&aemsgs);
 		pkg->clientdata->istobe = itb_installnew;
 		add_to_queue(pkg);
+		/* It might be waiting for a postinst which is still running,
+		 * so let one finish before giving up on ordering. */
+		if (configure_jobs_running()) {
+			configure_jobs_wait(false);
+			sincenothing = 0;
+		}
 		return;
 	}
 
@@ -320,6 +488,7 @@ deferred_configure(struct pkginfo *pkg)
 		 * Overriding conffiles is a silly thing to do anyway :-). */
 
 		modstatdb_note(pkg);
+		parse_filehash(pkg, true);
 
 		/* On entry, the ‘new’ version of each conffile has been
 		 * unpacked as ‘*.dpkg-new’, and the ‘installed’ version is
@@ -337,6 +506,11 @@ deferred_configure(struct pkginfo *pkg)
 
 	modstatdb_note(pkg);
 
+	if (configure_jobs_parallel()) {
+		configure_job_start(pkg);
+		return;
+	}
+
 	maintainer_script_postinst(pkg, "configure",
 	                           informativeversion(&pkg->configversion) ?
 	                           versiondescribe(&pkg->configversion,
@@ -470,29 +644,27 @@ md5hash(struct pkginfo *pkg, char *hashbuf, const char *fn)
 static void
 showdiff(const char *old, const char *new)
 {
+	const char *p;		/* pager */
+	const char *s;		/* shell */
+	char cmdbuf[1024];	/* command to run */
 	int pid;
 	int r;
 	int status;
 
-	pid = m_fork();
-	if (!pid) {
-		/* Child process. */
-		const char *p;		/* pager */
-		const char *s;		/* shell */
-		char cmdbuf[1024];	/* command to run */
+	p = getenv(PAGERENV);
+	if (!p || !*p)
+		p = DEFAULTPAGER;
 
-		p = getenv(PAGERENV);
-		if (!p || !*p)
-			p = DEFAULTPAGER;
+	sprintf(cmdbuf, DIFF " -Nu %.250s %.250s | %.250s", old, new, p);
 
-		sprintf(cmdbuf, DIFF " -Nu %.250s %.250s | %.250s", old, new, p);
+	s = getenv(SHELLENV);
+	if (!s || !*s)
+		s = DEFAULTSHELL;
 
-		s = getenv(SHELLENV);
-		if (!s || !*s)
-			s = DEFAULTSHELL;
+	{
+		const char *args[] = { s, "-c", cmdbuf, NULL };
 
-		execlp(s, s, "-c", cmdbuf, NULL);
-		ohshite(_("failed to run %s (%.250s)"), DIFF, cmdbuf);
+		pid = subproc_spawn(DIFF, s, args, NULL);
 	}
 
 	/* Parent process. */
@@ -524,15 +696,14 @@ suspend(void)
 
 		fputs(_("Type `exit' when you're done.\n"), stderr);
 
-		pid = m_fork();
-		if (!pid) {
-			/* Child process */
-			s = getenv(SHELLENV);
-			if (!s || !*s)
-				s = DEFAULTSHELL;
+		s = getenv(SHELLENV);
+		if (!s || !*s)
+			s = DEFAULTSHELL;
+
+		{
+			const char *args[] = { s, "-i", NULL };
 
-			execlp(s, s, "-i", NULL);
-			ohshite(_("failed to exec shell (%.250s)"), s);
+			pid = subproc_spawn(_("shell"), s, args, NULL);
 		}
 
 		/* Parent process. */
@@ -24,6 +24,7 @@
 #include <dpkg/i18n.h>
 
 #include <errno.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -32,6 +33,7 @@
 #include <dpkg/dpkg.h>
 #include <dpkg/dpkg-db.h>
 
+#include "filesdb.h"
 #include "main.h"
 
 struct cyclesofarlink {
@@ -43,6 +45,57 @@ struct cyclesofarlink {
 static bool findbreakcyclerecursive(struct pkginfo *pkg,
                                     struct cyclesofarlink *sofar);
 
+static struct {
+  unsigned long lookups;
+  unsigned long hits;
+} depcache_stats;
+
+/*
+ * Finding the package which provides a virtual package means walking
+ * all the reverse dependencies of the latter, and that has to be done
+ * again for every package depending on it, by dependencies_ok and by
+ * depisok. So we remember the provider which was found to satisfy an
+ * unversioned dependency, for as long as its status and version, and
+ * so its Provides, stay as they were. Callers still have to check that
+ * the provider is acceptable in their own context.
+ */
+struct pkginfo *depcache_lookup(struct pkginfo *virt) {
+  struct perpackagestate *cd;
+  struct pkginfo *provider;
+
+  depcache_stats.lookups++;
+  ensure_package_clientdata(virt);
+  cd= virt->clientdata;
+  provider= cd->satisfiedby;
+  if (!provider ||
+      provider->status != cd->satisfiedstatus ||
+      provider->installed.version.epoch != cd->satisfiedversion.epoch ||
+      provider->installed.version.version != cd->satisfiedversion.version ||
+      provider->installed.version.revision != cd->satisfiedversion.revision)
+    return NULL;
+  depcache_stats.hits++;
+  return provider;
+}
+
+void depcache_store(struct pkginfo *virt, struct pkginfo *provider) {
+  if (provider->status != stat_installed &&
+      provider->status != stat_triggerspending) return;
+  ensure_package_clientdata(virt);
+  virt->clientdata->satisfiedby= provider;
+  virt->clientdata->satisfiedstatus= provider->status;
+  virt->clientdata->satisfiedversion= provider->installed.version;
+}
+
+void depcache_report(void) {
+  debug(dbg_depcon, "provider cache: %lu lookups, %lu hits",
+        depcache_stats.lookups, depcache_stats.hits);
+}
+
+/* The packages coloured by the last search, which are the only ones
+ * whose colour needs to be reset before the next one. */
+static struct pkginfo **cyclevisited;
+static int ncyclevisited, maxcyclevisited;
+
 static bool
 foundcyclebroken(struct cyclesofarlink *thislink, struct cyclesofarlink *sofar,
                  struct pkginfo *dependedon, struct deppossi *possi)
@@ -106,6 +159,14 @@ findbreakcyclerecursive(struct pkginfo *pkg, struct cyclesofarlink *sofar)
 
   if (pkg->color == black)
     return false;
+  if (pkg->color == white) {
+    if (ncyclevisited == maxcyclevisited) {
+      maxcyclevisited = maxcyclevisited ? maxcyclevisited * 2 : 256;
+      cyclevisited = m_realloc(cyclevisited,
+                               maxcyclevisited * sizeof(*cyclevisited));
+    }
+    cyclevisited[ncyclevisited++] = pkg;
+  }
   pkg->color = gray;
   
   if (f_debug & dbg_depcondetail) {
@@ -154,18 +215,133 @@ findbreakcyclerecursive(struct pkginfo *pkg, struct cyclesofarlink *sofar)
 bool
 findbreakcycle(struct pkginfo *pkg)
 {
-  struct pkgiterator *iter;
-  struct pkginfo *tpkg;
-	
-  /* Clear the visited flag of all packages before we traverse them. */
-  for (iter = iterpkgstart(); (tpkg=iterpkgnext(iter)); ) {
-    tpkg->color = white;
-  }
-  iterpkgend(iter);
+  /* Clear the visited flag of the packages we traversed last time. */
+  while (ncyclevisited > 0)
+    cyclevisited[--ncyclevisited]->color = white;
 
   return findbreakcyclerecursive(pkg, NULL);
 }
 
+/*
+ * Ordering of the configure queue. The queued packages are sorted so
+ * that the packages each one depends on come before it, using Tarjan's
+ * algorithm on the Depends and Pre-Depends among them, so that most
+ * packages can be configured when they first come up instead of being
+ * requeued until their dependencies are done. The packages in a cycle
+ * end up next to each other, for process_queue to break the cycle.
+ */
+
+static struct {
+  struct pkginfo **stack;
+  int nstack;
+  int index;
+} scc;
+
+static bool
+sortqueuemember(struct pkginfo *pkg)
+{
+  return pkg->clientdata && pkg->clientdata->istobe == itb_installnew;
+}
+
+static void sortqueuevisit(struct pkginfo *pkg, struct pkgqueue *q);
+
+static void
+sortqueueedge(struct pkginfo *pkg, struct pkginfo *dependee,
+              struct pkgqueue *q)
+{
+  struct perpackagestate *ps = pkg->clientdata;
+  struct perpackagestate *ds;
+
+  if (!sortqueuemember(dependee))
+    return;
+  ds = dependee->clientdata;
+
+  if (!ds->sccindex) {
+    sortqueuevisit(dependee, q);
+    if (ds->scclowlink < ps->scclowlink)
+      ps->scclowlink = ds->scclowlink;
+  } else if (ds->sccstacked && ds->sccindex < ps->scclowlink) {
+    ps->scclowlink = ds->sccindex;
+  }
+}
+
+static void
+sortqueuevisit(struct pkginfo *pkg, struct pkgqueue *q)
+{
+  struct perpackagestate *ps = pkg->clientdata;
+  struct dependency *dep;
+  struct deppossi *possi, *providelink;
+  struct pkginfo *member;
+  int i, n;
+
+  ps->sccindex = ps->scclowlink = ++scc.index;
+  scc.stack[scc.nstack++] = pkg;
+  ps->sccstacked = true;
+
+  for (dep = pkg->installed.depends; dep; dep = dep->next) {
+    if (dep->type != dep_depends && dep->type != dep_predepends)
+      continue;
+    for (possi = dep->list; possi; possi = possi->next) {
+      sortqueueedge(pkg, possi->ed, q);
+      for (providelink = possi->ed->installed.depended;
+           providelink;
+           providelink = providelink->nextrev) {
+        if (providelink->up->type != dep_provides)
+          continue;
+        sortqueueedge(pkg, providelink->up->up, q);
+      }
+    }
+  }
+
+  if (ps->scclowlink != ps->sccindex)
+    return;
+
+  /* pkg is the root of a strongly connected component, all of whose
+   * dependencies have been queued already. Queue its members in the
+   * order they were reached, starting with pkg. */
+  for (i = scc.nstack - 1; scc.stack[i] != pkg; i--)
+    ;
+  for (n = i; n < scc.nstack; n++) {
+    member = scc.stack[n];
+    member->clientdata->sccstacked = false;
+    add_to_some_queue(member, q);
+    debug(dbg_depcondetail, "sortqueuebydepends %s%s", member->name,
+          member == pkg ? "" : " (cycle)");
+  }
+  scc.nstack = i;
+}
+
+void
+sortqueuebydepends(struct pkgqueue *q)
+{
+  struct pkg_list *node;
+  struct pkginfo **pkgs;
+  int npkgs = 0, i;
+
+  pkgs = m_malloc((q->length + 1) * sizeof(*pkgs));
+  while ((node = remove_from_some_queue(q))) {
+    /* Duplicates have been blanked out already. */
+    if (node->pkg) {
+      pkgs[npkgs++] = node->pkg;
+      node->pkg->clientdata->sccindex = 0;
+    }
+    free(node);
+  }
+
+  scc.stack = m_malloc((npkgs + 1) * sizeof(*scc.stack));
+  scc.nstack = 0;
+  scc.index = 0;
+
+  for (i = 0; i < npkgs; i++)
+    if (!pkgs[i]->clientdata->sccindex)
+      sortqueuevisit(pkgs[i], q);
+
+  debug(dbg_depcon, "sortqueuebydepends sorted %d packages", npkgs);
+
+  free(scc.stack);
+  free(pkgs);
+}
+
 void describedepcon(struct varbuf *addto, struct dependency *dep) {
   const char *fmt;
   struct varbuf depstr = VARBUF_INIT;
@@ -223,6 +399,7 @@ depisok(struct dependency *dep, struct varbuf *whynot,
    */
   struct deppossi *possi;
   struct deppossi *provider;
+  struct pkginfo *cached;
   int nconflicts;
 
   /* Use this buffer so that when internationalisation comes along we
@@ -361,7 +538,13 @@ depisok(struct dependency *dep, struct varbuf *whynot,
             return true;
         }
 
-        /* Now look at the packages already on the system. */
+        /* Now look at the packages already on the system, starting with
+         * the one found last time, if it is still fine. */
+        cached= depcache_lookup(possi->ed);
+        if (cached && cached->status == stat_installed &&
+            (cached->clientdata->istobe == itb_normal ||
+             cached->clientdata->istobe == itb_preinstall))
+          return true;
         for (provider= possi->ed->installed.depended;
              provider;
              provider= provider->nextrev) {
@@ -384,8 +567,10 @@ depisok(struct dependency *dep, struct varbuf *whynot,
                     provider->up->up->name, possi->ed->name);
             break;
           case itb_normal: case itb_preinstall:
-            if (provider->up->up->status == stat_installed)
+            if (provider->up->up->status == stat_installed) {
+              depcache_store(possi->ed, provider->up->up);
               return true;
+            }
             sprintf(linebuf, _("  %.250s provides %.250s but is %s.\n"),
                     provider->up->up->name, possi->ed->name,
                     gettext(statusstrings[provider->up->up->status]));
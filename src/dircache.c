@@ -0,0 +1,473 @@
+/*
+ * dpkg - main program for package management
+ * dircache.c - cache of open directories for the per-file syscalls
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with dpkg; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <config.h>
+#include <compat.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <dpkg/dpkg.h>
+#include <dpkg/dpkg-db.h>
+#include <dpkg/ioacct.h>
+
+#include "main.h"
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+/* Number of directories kept open. */
+#define DIRCACHE_SIZE	64
+
+struct dircache_entry {
+	/* Absolute directory name without the trailing slash, "" for "/". */
+	char *path;
+	size_t len;
+	int fd;
+	unsigned long used;
+	/* Not to be evicted, as its fd is still needed (see dircache_link). */
+	bool pinned;
+};
+
+static struct dircache_entry dircache[DIRCACHE_SIZE];
+static unsigned long dircache_clock;
+static bool dircache_enabled;
+static struct dircache_stats dircache_stats;
+
+static void
+dircache_evict(struct dircache_entry *e)
+{
+	close(e->fd);
+	dircache_stats.syscalls++;
+	free(e->path);
+	e->path = NULL;
+	e->fd = -1;
+	e->pinned = false;
+}
+
+static void
+dircache_flush(void)
+{
+	int i;
+
+	for (i = 0; i < DIRCACHE_SIZE; i++)
+		if (dircache[i].path)
+			dircache_evict(&dircache[i]);
+}
+
+static void
+dircache_insert(const char *path, size_t len, int fd)
+{
+	struct dircache_entry *e, *victim = NULL;
+	int i;
+
+	for (i = 0; i < DIRCACHE_SIZE; i++) {
+		e = &dircache[i];
+		if (!e->path) {
+			victim = e;
+			break;
+		}
+		if (e->pinned)
+			continue;
+		if (!victim || e->used < victim->used)
+			victim = e;
+	}
+	if (victim->path)
+		dircache_evict(victim);
+
+	victim->path = m_malloc(len + 1);
+	memcpy(victim->path, path, len);
+	victim->path[len] = '\0';
+	victim->len = len;
+	victim->fd = fd;
+	victim->used = ++dircache_clock;
+}
+
+/*
+ * Return an fd for the directory named by the first len bytes of path,
+ * or -1 if it cannot be opened. A directory not in the cache is opened
+ * relative to its parent, which is looked up the same way, so that only
+ * a single path component is resolved by the kernel for each miss.
+ */
+static int
+dircache_get(const char *path, size_t len)
+{
+	char name[NAME_MAX + 1];
+	const char *slash;
+	size_t parentlen, namelen;
+	int i, parentfd, fd;
+
+	for (i = 0; i < DIRCACHE_SIZE; i++) {
+		struct dircache_entry *e = &dircache[i];
+
+		if (e->path && e->len == len && memcmp(e->path, path, len) == 0) {
+			e->used = ++dircache_clock;
+			dircache_stats.hits++;
+			return e->fd;
+		}
+	}
+
+	if (len == 0) {
+		fd = open("/", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		dircache_stats.syscalls++;
+		ioacct_count(ioacct_open);
+		dircache_stats.pathwalks++;
+	} else {
+		for (slash = path + len - 1; slash > path && *slash != '/'; slash--)
+			;
+		if (*slash != '/')
+			return -1;
+
+		parentlen = slash - path;
+		namelen = len - parentlen - 1;
+		if (namelen == 0 || namelen > NAME_MAX)
+			return -1;
+		memcpy(name, slash + 1, namelen);
+		name[namelen] = '\0';
+		/* Keep the keys canonical, so that dircache_invalidate can
+		 * match them by prefix. */
+		if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+			return -1;
+
+		parentfd = dircache_get(path, parentlen);
+		if (parentfd < 0)
+			return -1;
+
+		fd = openat(parentfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		dircache_stats.syscalls++;
+		ioacct_count(ioacct_open);
+	}
+	dircache_stats.misses++;
+	if (fd < 0)
+		return -1;
+
+	dircache_insert(path, len, fd);
+
+	return fd;
+}
+
+/*
+ * Split pathname into a directory fd and the name relative to it. When
+ * the cache is not in use, or the directory cannot be opened, this
+ * returns AT_FDCWD and the whole pathname, so that the caller gets the
+ * same result, and errno, as with the plain syscall.
+ */
+static int
+dircache_lookup(const char *pathname, const char **base)
+{
+	const char *slash;
+	int fd;
+
+	if (dircache_enabled && pathname[0] == '/') {
+		slash = strrchr(pathname, '/');
+		if (slash[1] != '\0') {
+			fd = dircache_get(pathname, slash - pathname);
+			if (fd >= 0) {
+				*base = slash + 1;
+				return fd;
+			}
+		}
+	}
+
+	*base = pathname;
+	dircache_stats.pathwalks++;
+	return AT_FDCWD;
+}
+
+/*
+ * Keep the entry for dirfd, as returned by dircache_lookup, from being
+ * evicted while another directory is looked up, or allow it again.
+ * At most one entry is pinned at a time, so there is always one left
+ * to evict.
+ */
+static void
+dircache_pin(int dirfd, bool pinned)
+{
+	int i;
+
+	if (dirfd == AT_FDCWD)
+		return;
+
+	for (i = 0; i < DIRCACHE_SIZE; i++) {
+		if (dircache[i].path && dircache[i].fd == dirfd) {
+			dircache[i].pinned = pinned;
+			return;
+		}
+	}
+}
+
+/*
+ * Forget pathname and anything below it. This has to be called whenever
+ * a directory might have been renamed or removed behind our back.
+ */
+void
+dircache_invalidate(const char *pathname)
+{
+	size_t len = strlen(pathname);
+	int i;
+
+	while (len > 1 && pathname[len - 1] == '/')
+		len--;
+
+	for (i = 0; i < DIRCACHE_SIZE; i++) {
+		struct dircache_entry *e = &dircache[i];
+
+		if (!e->path || e->len < len)
+			continue;
+		if (memcmp(e->path, pathname, len) != 0)
+			continue;
+		if (e->len == len || e->path[len] == '/')
+			dircache_evict(e);
+	}
+}
+
+/*
+ * Start caching directories. Nothing else may rename or remove
+ * directories in the tree until dircache_stop is called, other than
+ * through the functions below.
+ */
+void
+dircache_start(void)
+{
+	dircache_flush();
+	memset(&dircache_stats, 0, sizeof(dircache_stats));
+	dircache_enabled = true;
+}
+
+void
+dircache_stop(void)
+{
+	dircache_flush();
+	dircache_enabled = false;
+}
+
+void
+dircache_get_stats(struct dircache_stats *stats)
+{
+	*stats = dircache_stats;
+}
+
+int
+dircache_lstat(const char *pathname, struct stat *st)
+{
+	const char *base;
+	int dirfd = dircache_lookup(pathname, &base);
+
+	dircache_stats.syscalls++;
+	ioacct_count(ioacct_stat);
+	return fstatat(dirfd, base, st, AT_SYMLINK_NOFOLLOW);
+}
+
+int
+dircache_stat(const char *pathname, struct stat *st)
+{
+	const char *base;
+	int dirfd = dircache_lookup(pathname, &base);
+
+	dircache_stats.syscalls++;
+	ioacct_count(ioacct_stat);
+	return fstatat(dirfd, base, st, 0);
+}
+
+int
+dircache_open(const char *pathname, int flags, mode_t mode)
+{
+	const char *base;
+	int dirfd = dircache_lookup(pathname, &base);
+
+	dircache_stats.syscalls++;
+	ioacct_count(ioacct_open);
+	return openat(dirfd, base, flags, mode);
+}
+
+int
+dircache_mkdir(const char *pathname, mode_t mode)
+{
+	const char *base;
+	int dirfd = dircache_lookup(pathname, &base);
+
+	dircache_stats.syscalls++;
+	ioacct_count(ioacct_other);
+	return mkdirat(dirfd, base, mode);
+}
+
+int
+dircache_mknod(const char *pathname, mode_t mode, dev_t dev)
+{
+	const char *base;
+	int dirfd = dircache_lookup(pathname, &base);
+
+	dircache_stats.syscalls++;
+	ioacct_count(ioacct_other);
+	return mknodat(dirfd, base, mode, dev);
+}
+
+int
+dircache_symlink(const char *target, const char *pathname)
+{
+	const char *base;
+	int dirfd = dircache_lookup(pathname, &base);
+
+	dircache_stats.syscalls++;
+	ioacct_count(ioacct_other);
+	return symlinkat(target, dirfd, base);
+}
+
+ssize_t
+dircache_readlink(const char *pathname, char *buf, size_t bufsize)
+{
+	const char *base;
+	int dirfd = dircache_lookup(pathname, &base);
+
+	dircache_stats.syscalls++;
+	ioacct_count(ioacct_other);
+	return readlinkat(dirfd, base, buf, bufsize);
+}
+
+int
+dircache_link(const char *oldpath, const char *newpath)
+{
+	const char *oldbase, *newbase;
+	int olddirfd, newdirfd;
+
+	olddirfd = dircache_lookup(oldpath, &oldbase);
+	/* Looking up newpath must not close olddirfd under us. */
+	dircache_pin(olddirfd, true);
+	newdirfd = dircache_lookup(newpath, &newbase);
+	dircache_pin(olddirfd, false);
+
+	dircache_stats.syscalls++;
+	ioacct_count(ioacct_other);
+	return linkat(olddirfd, oldbase, newdirfd, newbase, 0);
+}
+
+int
+dircache_rename(const char *oldpath, const char *newpath)
+{
+	const char *oldbase, *newbase;
+	int olddirfd, newdirfd, r;
+
+	olddirfd = dircache_lookup(oldpath, &oldbase);
+	dircache_pin(olddirfd, true);
+	newdirfd = dircache_lookup(newpath, &newbase);
+	dircache_pin(olddirfd, false);
+
+	dircache_stats.syscalls++;
+	ioacct_count(ioacct_rename);
+	r = renameat(olddirfd, oldbase, newdirfd, newbase);
+	if (r == 0) {
+		dircache_invalidate(oldpath);
+		dircache_invalidate(newpath);
+	}
+
+	return r;
+}
+
+int
+dircache_unlink(const char *pathname)
+{
+	const char *base;
+	int dirfd = dircache_lookup(pathname, &base);
+	int r;
+
+	dircache_stats.syscalls++;
+	ioacct_count(ioacct_unlink);
+	r = unlinkat(dirfd, base, 0);
+	/* It might have been a symlink to a directory, cached under its
+	 * own name. */
+	if (r == 0)
+		dircache_invalidate(pathname);
+
+	return r;
+}
+
+int
+dircache_rmdir(const char *pathname)
+{
+	const char *base;
+	int dirfd = dircache_lookup(pathname, &base);
+	int r;
+
+	dircache_stats.syscalls++;
+	ioacct_count(ioacct_unlink);
+	r = unlinkat(dirfd, base, AT_REMOVEDIR);
+	if (r == 0)
+		dircache_invalidate(pathname);
+
+	return r;
+}
+
+int
+dircache_chown(const char *pathname, uid_t uid, gid_t gid)
+{
+	const char *base;
+	int dirfd = dircache_lookup(pathname, &base);
+
+	dircache_stats.syscalls++;
+	ioacct_count(ioacct_other);
+	return fchownat(dirfd, base, uid, gid, 0);
+}
+
+int
+dircache_lchown(const char *pathname, uid_t uid, gid_t gid)
+{
+	const char *base;
+	int dirfd = dircache_lookup(pathname, &base);
+
+	dircache_stats.syscalls++;
+	ioacct_count(ioacct_other);
+	return fchownat(dirfd, base, uid, gid, AT_SYMLINK_NOFOLLOW);
+}
+
+int
+dircache_chmod(const char *pathname, mode_t mode)
+{
+	const char *base;
+	int dirfd = dircache_lookup(pathname, &base);
+
+	dircache_stats.syscalls++;
+	ioacct_count(ioacct_other);
+	return fchmodat(dirfd, base, mode, 0);
+}
+
+int
+dircache_utime(const char *pathname, const struct utimbuf *utb)
+{
+	struct timespec times[2];
+	const char *base;
+	int dirfd = dircache_lookup(pathname, &base);
+
+	times[0].tv_sec = utb->actime;
+	times[0].tv_nsec = 0;
+	times[1].tv_sec = utb->modtime;
+	times[1].tv_nsec = 0;
+
+	dircache_stats.syscalls++;
+	ioacct_count(ioacct_other);
+	return utimensat(dirfd, base, times, 0);
+}
@@ -34,6 +34,7 @@
 #include <dpkg/dpkg.h>
 #include <dpkg/i18n.h>
 #include <dpkg/dpkg-db.h>
+#include <dpkg/subproc.h>
 
 const char thisname[]= "dpkg-divert";
 
@@ -214,23 +215,14 @@ checkrename(const char *rsrc, const char *rdest)
 static int
 rename_mv(const char *src, const char *dest)
 {
+	const char *args[] = { "mv", src, dest, NULL };
 	pid_t pid;
+	int status;
 
 	if (rename(src, dest) == 0)
 		return 0;
 
-	pid = fork();
-	if(pid == -1)
-		return -1;
-
-	if (!pid) {
-		/* child */
-		execlp("mv", "mv", src, dest, NULL);
-		exit(EXIT_FAILURE);
-	}
-
-	/* parent */
-	int status;
+	pid = subproc_spawn("mv", "mv", args, NULL);
 	if(waitpid(pid, &status, 0) == -1)
 		return -1;
 
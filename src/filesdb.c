@@ -40,6 +40,7 @@
 #include <dpkg/dpkg-db.h>
 #include <dpkg/path.h>
 #include <dpkg/buffer.h>
+#include <dpkg/ioacct.h>
 #include <dpkg/progress.h>
 
 #include "filesdb.h"
@@ -60,6 +61,11 @@ ensure_package_clientdata(struct pkginfo *pkg)
   pkg->clientdata->fileslistvalid = 0;
   pkg->clientdata->files = NULL;
   pkg->clientdata->trigprocdeferred = NULL;
+  pkg->clientdata->trigprocpostponed = 0;
+  pkg->clientdata->sccindex = 0;
+  pkg->clientdata->scclowlink = 0;
+  pkg->clientdata->sccstacked = false;
+  pkg->clientdata->satisfiedby = NULL;
 }
 
 void note_must_reread_files_inpackage(struct pkginfo *pkg) {
@@ -132,6 +138,7 @@ void ensure_packagefiles_available(struct pkginfo *pkg) {
 
   onerr_abort++;
   
+  ioacct_count(ioacct_open);
   fd= open(filelistfile,O_RDONLY);
 
   if (fd==-1) {
@@ -150,6 +157,7 @@ void ensure_packagefiles_available(struct pkginfo *pkg) {
 
   push_cleanup(cu_closefd, ehflag_bombout, NULL, 0, 1, &fd);
   
+   ioacct_count(ioacct_stat);
    if(fstat(fd, &stat_buf))
      ohshite(_("unable to stat files list file for package '%.250s'"),
              pkg->name);
@@ -214,8 +222,10 @@ void ensure_allinstfiles_available(void) {
   struct pkgiterator *it;
   struct pkginfo *pkg;
   struct progress progress;
+  struct timespan span;
 
   if (allpackagesdone) return;
+  timespan_start(&span, "filesdb", NULL);
   if (saidread<2) {
     int max = countpackages();
 
@@ -238,6 +248,8 @@ void ensure_allinstfiles_available(void) {
     printf(_("%d files and directories currently installed.)\n"),nfiles);
     saidread=2;
   }
+
+  timespan_end(&span);
 }
 
 void ensure_allinstfiles_available_quiet(void) {
@@ -264,6 +276,7 @@ void write_filelist_except(struct pkginfo *pkg, struct fileinlist *list, int lea
   varbufaddstr(&newvb,NEWDBEXT);
   varbufaddc(&newvb,0);
   
+  ioacct_count(ioacct_open);
   file= fopen(newvb.buf,"w+");
   if (!file)
     ohshite(_("unable to create updated files list file for package %s"),pkg->name);
@@ -279,48 +292,213 @@ void write_filelist_except(struct pkginfo *pkg, struct fileinlist *list, int lea
     ohshite(_("failed to write to updated files list file for package %s"),pkg->name);
   if (fflush(file))
     ohshite(_("failed to flush updated files list file for package %s"),pkg->name);
-  if (fsync(fileno(file)))
-    ohshite(_("failed to sync updated files list file for package %s"),pkg->name);
+  ioacct_written(ftell(file));
+  if (!modstatdb_is_unsafe_io()) {
+    ioacct_count(ioacct_fsync);
+    if (fsync(fileno(file)))
+      ohshite(_("failed to sync updated files list file for package %s"),pkg->name);
+  }
   pop_cleanup(ehflag_normaltidy); /* file= fopen() */
   if (fclose(file))
     ohshite(_("failed to close updated files list file for package %s"),pkg->name);
+  ioacct_count(ioacct_rename);
   if (rename(newvb.buf,vb.buf))
     ohshite(_("failed to install updated files list file for package %s"),pkg->name);
 
   note_must_reread_files_inpackage(pkg);
 }
 
+void write_filehash(struct pkginfo *pkg, struct fileinlist *list) {
+  /* Writes the digests computed by tarobject while unpacking, in the
+   * format understood by md5sum -c, so that the files can be verified
+   * and conffiles need not be read back in again on configure.
+   */
+  static struct varbuf vb, newvb;
+  FILE *file;
+
+  varbufreset(&vb);
+  varbufaddstr(&vb,admindir);
+  varbufaddstr(&vb,"/" INFODIR);
+  varbufaddstr(&vb,pkg->name);
+  varbufaddstr(&vb,"." HASHFILE);
+  varbufaddc(&vb,0);
+
+  varbufreset(&newvb);
+  varbufaddstr(&newvb,vb.buf);
+  varbufaddstr(&newvb,NEWDBEXT);
+  varbufaddc(&newvb,0);
+
+  ioacct_count(ioacct_open);
+  file= fopen(newvb.buf,"w+");
+  if (!file)
+    ohshite(_("unable to create updated files hash file for package %s"),pkg->name);
+  push_cleanup(cu_closefile, ehflag_bombout, NULL, 0, 1, (void *)file);
+  while (list) {
+    if (list->namenode->newhash)
+      fprintf(file, "%s  %s\n", list->namenode->newhash,
+              list->namenode->name + 1);
+    list= list->next;
+  }
+  if (ferror(file))
+    ohshite(_("failed to write to updated files hash file for package %s"),pkg->name);
+  if (fflush(file))
+    ohshite(_("failed to flush updated files hash file for package %s"),pkg->name);
+  ioacct_written(ftell(file));
+  if (!modstatdb_is_unsafe_io()) {
+    ioacct_count(ioacct_fsync);
+    if (fsync(fileno(file)))
+      ohshite(_("failed to sync updated files hash file for package %s"),pkg->name);
+  }
+  pop_cleanup(ehflag_normaltidy); /* file= fopen() */
+  if (fclose(file))
+    ohshite(_("failed to close updated files hash file for package %s"),pkg->name);
+  ioacct_count(ioacct_rename);
+  if (rename(newvb.buf,vb.buf))
+    ohshite(_("failed to install updated files hash file for package %s"),pkg->name);
+}
+
+static void filehash_reset(struct pkginfo *pkg, bool conffiles) {
+  struct conffile *conff;
+  struct fileinlist *file;
+  struct filenamenode *namenode;
+
+  if (conffiles) {
+    for (conff= pkg->installed.conffiles; conff; conff= conff->next) {
+      namenode= findnamenode(conff->name, fnn_nonew);
+      if (namenode) namenode->newhash= NULL;
+    }
+  } else {
+    for (file= pkg->clientdata->files; file; file= file->next)
+      file->namenode->newhash= NULL;
+  }
+}
+
+static struct filenamenode *filehash_namenode(struct pkginfo *pkg,
+                                              bool conffiles,
+                                              const char *name) {
+  struct conffile *conff;
+
+  if (!conffiles)
+    return findnamenode(name, fnn_nonew);
+
+  /* The conffile namenodes are the ones configure is going to look up
+   * anyway, so we can create them here, but not any other. */
+  name= path_skip_slash_dotslash(name);
+  for (conff= pkg->installed.conffiles; conff; conff= conff->next)
+    if (!strcmp(path_skip_slash_dotslash(conff->name), name))
+      return findnamenode(conff->name, fnn_nocopy);
+  return NULL;
+}
+
+void parse_filehash(struct pkginfo *pkg, bool conffiles) {
+  /* Loads the digests stored by write_filehash into the newhash field
+   * of the namenodes, either of the conffiles of pkg only, or of all its
+   * files, which the caller must have loaded.  Any digest left over in
+   * those namenodes from another package is cleared first, so that
+   * callers see either the digest of pkg or none, and must cope with
+   * missing ones anyway.  Lines we do not understand are skipped.
+   */
+  const char *hashfile;
+  char linebuf[MD5HASHLEN + 2 + MAXDIVERTFILENAME];
+  struct filenamenode *namenode;
+  FILE *file;
+  char *p;
+  int l;
+
+  filehash_reset(pkg, conffiles);
+  if (conffiles && !pkg->installed.conffiles)
+    return;
+
+  hashfile= pkgadminfile(pkg,HASHFILE);
+  ioacct_count(ioacct_open);
+  file= fopen(hashfile,"r");
+  if (!file && errno == ENOENT && !conffiles) {
+    /* Installed by a dpkg which did not record the digests, fall back to
+     * the ones shipped by the package, which are fine to verify against
+     * but not to trust for the conffiles. */
+    hashfile= pkgadminfile(pkg,MD5SUMSFILE);
+    ioacct_count(ioacct_open);
+    file= fopen(hashfile,"r");
+  }
+  if (!file) {
+    if (errno != ENOENT)
+      warning(_("unable to open files hash file for package %s: %s"),
+              pkg->name, strerror(errno));
+    return;
+  }
+  push_cleanup(cu_closefile, ehflag_bombout, NULL, 0, 1, (void *)file);
+  while (fgets(linebuf, sizeof(linebuf), file)) {
+    l= strlen(linebuf);
+    if (l == 0 || linebuf[l - 1] != '\n')
+      continue;
+    linebuf[--l]= '\0';
+    if (l <= MD5HASHLEN + 2 || linebuf[MD5HASHLEN] != ' ')
+      continue;
+    linebuf[MD5HASHLEN]= '\0';
+    if (strspn(linebuf, "0123456789abcdef") != MD5HASHLEN)
+      continue;
+    p= linebuf + MD5HASHLEN + 1;
+    /* Skip the text or binary mode indicator. */
+    if (*p == ' ' || *p == '*')
+      p++;
+    namenode= filehash_namenode(pkg, conffiles, p);
+    if (namenode)
+      namenode->newhash= nfstrsave(linebuf);
+  }
+  if (ferror(file))
+    warning(_("error reading files hash file for package %s: %s"),
+            pkg->name, strerror(errno));
+  pop_cleanup(ehflag_normaltidy); /* file= fopen() */
+  fclose(file);
+}
+
+/* The array of the last finished iteration, kept for the next one so
+ * that iterating does not allocate anything in the common case. */
+static struct filenamenode **reversefilelist_spare;
+static int reversefilelist_sparesize;
+
 void reversefilelist_init(struct reversefilelistiter *iterptr,
                           struct fileinlist *files) {
   /* Initialises an iterator that appears to go through the file
    * list `files' in reverse order, returning the namenode from
-   * each.  What actually happens is that we walk the list here,
-   * building up a reverse list, and then peel it apart one
-   * entry at a time.
+   * each.  What actually happens is that we take a snapshot of
+   * the namenodes into an array here, and then walk it backwards.
    */
-  struct fileinlist *newent;
-  
-  iterptr->todo = NULL;
-  while (files) {
-    newent= m_malloc(sizeof(struct fileinlist));
-    newent->namenode= files->namenode;
-    newent->next= iterptr->todo;
-    iterptr->todo= newent;
-    files= files->next;
+  struct fileinlist *file;
+  int n;
+
+  for (n= 0, file= files; file; file= file->next)
+    n++;
+
+  if (reversefilelist_spare && reversefilelist_sparesize >= n) {
+    iterptr->namenodes= reversefilelist_spare;
+    iterptr->size= reversefilelist_sparesize;
+    reversefilelist_spare= NULL;
+  } else {
+    iterptr->size= n > 256 ? n : 256;
+    iterptr->namenodes= m_malloc(sizeof(*iterptr->namenodes) * iterptr->size);
   }
+
+  for (n= 0, file= files; file; file= file->next)
+    iterptr->namenodes[n++]= file->namenode;
+  iterptr->todo= n;
 }
 
 struct filenamenode *reversefilelist_next(struct reversefilelistiter *iterptr) {
-  struct filenamenode *ret;
-  struct fileinlist *todo;
-
-  todo= iterptr->todo;
-  if (!todo)
-    return NULL;
-  ret= todo->namenode;
-  iterptr->todo= todo->next;
-  free(todo);
-  return ret;
+  if (iterptr->todo > 0)
+    return iterptr->namenodes[--iterptr->todo];
+
+  if (iterptr->namenodes) {
+    if (!reversefilelist_spare || reversefilelist_sparesize < iterptr->size) {
+      free(reversefilelist_spare);
+      reversefilelist_spare= iterptr->namenodes;
+      reversefilelist_sparesize= iterptr->size;
+    } else {
+      free(iterptr->namenodes);
+    }
+    iterptr->namenodes= NULL;
+  }
+  return NULL;
 }
 
 void reversefilelist_abort(struct reversefilelistiter *iterptr) {
@@ -329,7 +507,8 @@ void reversefilelist_abort(struct reversefilelistiter *iterptr) {
    * Calling this function is not necessary if reversefilelist_next has
    * been called until it returned 0.
    */
-  while (reversefilelist_next(iterptr));
+  iterptr->todo= 0;
+  reversefilelist_next(iterptr);
 }
 
 struct fileiterator {
@@ -378,6 +557,7 @@ void filesdbinit(void) {
     for (fnn= bins[i]; fnn; fnn= fnn->next) {
       fnn->flags= 0;
       fnn->oldhash = NULL;
+      fnn->newhash = NULL;
       fnn->filestat = NULL;
     }
 }
@@ -420,6 +600,8 @@ struct filenamenode *findnamenode(const char *name, enum fnnflags flags) {
   newnode->next = NULL;
   newnode->divert = NULL;
   newnode->statoverride = NULL;
+  newnode->oldhash = NULL;
+  newnode->newhash = NULL;
   newnode->filestat = NULL;
   newnode->trig_interested = NULL;
   *pointerp= newnode;
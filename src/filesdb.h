@@ -70,8 +70,10 @@ struct filenamenode {
     fnnf_elide_other_lists=   000010, /* must remove from other packages' lists */
     fnnf_no_atomic_overwrite= 000020, /* >=1 instance is a dir, cannot rename over */
     fnnf_placed_on_disk=      000040, /* new file has been placed on the disk */
+    fnnf_deferred_rename=     000400, /* new file still in .dpkg-new, needs rename */
   } flags; /* Set to zero when a new node is created. */
   const char *oldhash; /* valid iff this namenode is in the newconffiles list */
+  const char *newhash; /* md5sum of the new file, set by tarobject or parse_filehash */
   struct stat *filestat;
   struct trigfileint *trig_interested;
 };
@@ -145,6 +147,8 @@ mode_t statdb_parse_mode(const char *str);
 void ensure_statoverrides(void);
 
 #define LISTFILE           "list"
+#define HASHFILE           "hashes"
+#define MD5SUMSFILE        "md5sums"
 
 void ensure_packagefiles_available(struct pkginfo *pkg);
 void ensure_allinstfiles_available(void);
@@ -152,8 +156,13 @@ void ensure_allinstfiles_available_quiet(void);
 void note_must_reread_files_inpackage(struct pkginfo *pkg);
 struct filenamenode *findnamenode(const char *filename, enum fnnflags flags);
 void write_filelist_except(struct pkginfo *pkg, struct fileinlist *list, int leaveout);
+void write_filehash(struct pkginfo *pkg, struct fileinlist *list);
+void parse_filehash(struct pkginfo *pkg, bool conffiles);
 
-struct reversefilelistiter { struct fileinlist *todo; };
+struct reversefilelistiter {
+  struct filenamenode **namenodes;
+  int size, todo;
+};
 
 void reversefilelist_init(struct reversefilelistiter *iterptr, struct fileinlist *files);
 struct filenamenode *reversefilelist_next(struct reversefilelistiter *iterptr);
@@ -26,6 +26,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <dirent.h>
 #include <assert.h>
 #include <string.h>
@@ -170,17 +171,13 @@ force_conflicts(struct deppossi *possi)
 }
 
 static const char* preexecscript(const char *path, char *const *argv) {
-  /* returns the path to the script inside the chroot
+  /* returns the path to the script inside the chroot, which the spawned
+   * child enters.
    * FIXME: none of the stuff here will work if admindir isn't inside
    * instdir as expected.
    */
   size_t instdirl;
 
-  if (*instdir) {
-    if (chroot(instdir)) ohshite(_("failed to chroot to `%.250s'"),instdir);
-    if (chdir("/"))
-      ohshite(_("failed to chdir to `%.255s'"), "/");
-  }
   if (f_debug & dbg_scripts) {
     struct varbuf args = VARBUF_INIT;
 
@@ -189,7 +186,7 @@ static const char* preexecscript(const char *path, char *const *argv) {
       varbufaddstr(&args, *argv);
     }
     varbufaddc(&args, '\0');
-    debug(dbg_scripts, "fork/exec %s (%s )", path, args.buf);
+    debug(dbg_scripts, "spawn %s (%s )", path, args.buf);
     varbuffree(&args);
   }
   instdirl= strlen(instdir);
@@ -198,6 +195,57 @@ static const char* preexecscript(const char *path, char *const *argv) {
   return path+instdirl;
 }  
 
+extern char **environ;
+
+static const char *const script_env_names[]= {
+  MAINTSCRIPTPKGENVVAR, MAINTSCRIPTARCHENVVAR, MAINTSCRIPTDPKGENVVAR
+};
+
+/* Returns a copy of our environment with the variables telling the
+ * maintainer script who runs it added at the end. */
+static char **build_script_env(struct pkginfo *pkg,
+                               struct pkginfoperfile *pif) {
+  const char *values[sizeof_array(script_env_names)];
+  struct varbuf vb = VARBUF_INIT;
+  char **envp, **ep;
+  size_t i, l;
+  int n;
+
+  values[0]= pkg->name;
+  values[1]= pif->architecture;
+  values[2]= PACKAGE_VERSION;
+
+  for (n=0; environ[n]; n++) ;
+  envp= m_malloc((n + sizeof_array(script_env_names) + 1) * sizeof(*envp));
+  for (ep= envp, n=0; environ[n]; n++) {
+    for (i=0; i < sizeof_array(script_env_names); i++) {
+      l= strlen(script_env_names[i]);
+      if (!strncmp(environ[n], script_env_names[i], l) && environ[n][l] == '=')
+        break;
+    }
+    if (i == sizeof_array(script_env_names)) *ep++= environ[n];
+  }
+  for (i=0; i < sizeof_array(script_env_names); i++) {
+    varbufreset(&vb);
+    varbufprintf(&vb, "%s=%s", script_env_names[i], values[i] ? values[i] : "");
+    *ep++= m_strdup(vb.buf);
+  }
+  *ep= NULL;
+  varbuffree(&vb);
+
+  return envp;
+}
+
+static void free_script_env(char **envp) {
+  size_t i;
+  int n;
+
+  for (n=0; envp[n]; n++) ;
+  for (i=0; i < sizeof_array(script_env_names); i++)
+    free(envp[--n]);
+  free(envp);
+}
+
 static char *const *vbuildarglist(const char *scriptname, va_list ap) {
   static char *bufs[PKGSCRIPTMAXARGS+1];
   char *nextarg;
@@ -230,6 +278,7 @@ void
 post_postinst_tasks(struct pkginfo *pkg, enum pkgstatus new_status)
 {
   pkg->trigpend_head = NULL;
+  trig_activation_forget();
   pkg->status = pkg->trigaw.head ? stat_triggersawaited : new_status;
 
   post_postinst_tasks_core(pkg);
@@ -268,36 +317,58 @@ static void setexecute(const char *path, struct stat *stab) {
   ohshite(_("unable to set execute permissions on `%.250s'"),path);
 }
 
+static pid_t
+do_script_fork(struct pkginfo *pkg, struct pkginfoperfile *pif,
+               const char *scriptpath, char *const arglist[],
+               const char *name)
+{
+  struct subproc_spawn sp = SUBPROC_SPAWN_INIT;
+  struct subproc_spawn_stats stats;
+  const char *scriptexec;
+  const char **narglist;
+  char **envp;
+  pid_t c1;
+  int r;
+
+  for (r=0; arglist[r]; r++) ;
+  narglist=m_malloc((r+1)*sizeof(char*));
+  for (r=1; arglist[r-1]; r++)
+    narglist[r]= arglist[r];
+  scriptexec= preexecscript(scriptpath,(char * const *)narglist);
+  narglist[0]= scriptexec;
+
+  envp= build_script_env(pkg, pif);
+  sp.envp= envp;
+  if (*instdir)
+    sp.root= instdir;
+  c1= subproc_spawn(name, scriptexec, narglist, &sp);
+  free_script_env(envp);
+  free(narglist);
+
+  subproc_spawn_get_stats(&stats);
+  debug(dbg_scripts, "spawned %s in %lu us", name, stats.last_usecs);
+
+  return c1;
+}
+
 static int
 do_script(struct pkginfo *pkg, struct pkginfoperfile *pif,
           const char *scriptname, const char *scriptpath, struct stat *stab,
-          char *const arglist[], const char *desc, const char *name, int warn)
+          char *const arglist[], const char *name, int warn)
 {
-  const char *scriptexec;
-  int c1, r;
+  struct timespan span;
+  pid_t c1;
+  int r;
   setexecute(scriptpath,stab);
 
   push_cleanup(cu_post_script_tasks, ehflag_bombout, NULL, 0, 0);
 
-  c1= m_fork();
-  if (!c1) {
-    const char **narglist;
-    for (r=0; arglist[r]; r++) ;
-    narglist=nfmalloc((r+1)*sizeof(char*));
-    for (r=1; arglist[r-1]; r++)
-      narglist[r]= arglist[r];
-    scriptexec= preexecscript(scriptpath,(char * const *)narglist);
-    narglist[0]= scriptexec;
-    if (setenv(MAINTSCRIPTPKGENVVAR, pkg->name, 1) ||
-        setenv(MAINTSCRIPTARCHENVVAR, pif->architecture, 1) ||
-        setenv(MAINTSCRIPTDPKGENVVAR, PACKAGE_VERSION, 1))
-      ohshite(_("unable to setenv for maintainer script"));
-    execv(scriptexec,(char * const *)narglist);
-    ohshite(desc,name);
-  }
+  timespan_start(&span, scriptname, pkg->name);
+  c1 = do_script_fork(pkg, pif, scriptpath, arglist, name);
   setup_subproc_signals(name); /* This does a push_cleanup() */
   r= waitsubproc(c1,name,warn);
   pop_cleanup(ehflag_normaltidy);
+  timespan_end(&span);
 
   pop_cleanup(ehflag_normaltidy);
 
@@ -326,7 +397,7 @@ vmaintainer_script_installed(struct pkginfo *pkg, const char *scriptname,
     ohshite(_("unable to stat %s `%.250s'"), buf, scriptpath);
   }
   do_script(pkg, &pkg->installed, scriptname, scriptpath, &stab,
-            arglist, _("unable to execute %s"), buf, 0);
+            arglist, buf, 0);
 
   return 1;
 }
@@ -363,6 +434,54 @@ maintainer_script_postinst(struct pkginfo *pkg, ...)
   return r;
 }
 
+/*
+ * Start the postinst without waiting for it, for --jobs. Returns the pid
+ * of the script, or 0 if the package has none. The caller must pass the
+ * exit status to maintainer_script_postinst_done.
+ */
+pid_t
+maintainer_script_postinst_start(struct pkginfo *pkg, ...)
+{
+  const char *scriptpath;
+  char *const *arglist;
+  struct stat stab;
+  char buf[100];
+  va_list ap;
+
+  scriptpath = pkgadminfile(pkg, POSTINSTFILE);
+  sprintf(buf, _("installed %s script"), "post-installation");
+
+  if (stat(scriptpath, &stab)) {
+    if (errno == ENOENT) {
+      debug(dbg_scripts, "maintainer_script_postinst_start nonexistent %s",
+            POSTINSTFILE);
+      return 0;
+    }
+    ohshite(_("unable to stat %s `%.250s'"), buf, scriptpath);
+  }
+  setexecute(scriptpath, &stab);
+
+  va_start(ap, pkg);
+  arglist = vbuildarglist(POSTINSTFILE, ap);
+  va_end(ap);
+
+  return do_script_fork(pkg, &pkg->installed, scriptpath, arglist, buf);
+}
+
+void
+maintainer_script_postinst_done(struct pkginfo *pkg, int status)
+{
+  char buf[100];
+
+  sprintf(buf, _("installed %s script"), "post-installation");
+
+  push_cleanup(cu_post_script_tasks, ehflag_bombout, NULL, 0, 0);
+  checksubprocerr(status, buf, 0);
+  pop_cleanup(ehflag_normaltidy);
+
+  ensure_diversions();
+}
+
 int
 maintainer_script_new(struct pkginfo *pkg,
                       const char *scriptname, const char *description,
@@ -387,7 +506,7 @@ maintainer_script_new(struct pkginfo *pkg,
     ohshite(_("unable to stat %s `%.250s'"), buf, cidir);
   }
   do_script(pkg, &pkg->available, scriptname, cidir, &stab,
-            arglist, _("unable to execute %s"), buf, 0);
+            arglist, buf, 0);
   post_script_tasks();
 
   return 1;
@@ -418,7 +537,7 @@ int maintainer_script_alternative(struct pkginfo *pkg,
             buf,oldscriptpath,strerror(errno));
   } else {
     if (!do_script(pkg, &pkg->installed, scriptname, oldscriptpath, &stab,
-                   arglist, _("unable to execute %s"), buf, PROCWARN)) {
+                   arglist, buf, PROCWARN)) {
       post_script_tasks();
       return 1;
     }
@@ -440,7 +559,7 @@ int maintainer_script_alternative(struct pkginfo *pkg,
   }
 
   do_script(pkg, &pkg->available, scriptname, cidir, &stab,
-            arglist, _("unable to execute %s"), buf, 0);
+            arglist, buf, 0);
   fprintf(stderr, _("dpkg: ... it looks like that went OK.\n"));
 
   post_script_tasks();
@@ -549,33 +668,114 @@ secure_unlink(const char *pathname)
 {
   struct stat stab;
 
-  if (lstat(pathname,&stab)) return -1;
+  if (dircache_lstat(pathname,&stab)) return -1;
 
   return secure_unlink_statted(pathname, &stab);
 }
 
 int
 secure_unlink_statted(const char *pathname, const struct stat *stab)
+{
+  if (secure_unlink_prepare(pathname, stab)) return -1;
+  if (dircache_unlink(pathname)) return -1;
+  return 0;
+}
+
+/* Do the mode change of secure_unlink_statted, for callers which want
+ * to issue the unlink themselves. */
+int
+secure_unlink_prepare(const char *pathname, const struct stat *stab)
 {
   if (S_ISREG(stab->st_mode) ? (stab->st_mode & 07000) :
       !(S_ISLNK(stab->st_mode) || S_ISDIR(stab->st_mode) ||
 	S_ISFIFO(stab->st_mode) || S_ISSOCK(stab->st_mode))) {
-    if (chmod(pathname, 0600))
+    if (dircache_chmod(pathname, 0600))
       return -1;
   }
-  if (unlink(pathname)) return -1;
   return 0;
 }
 
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+/* Number of times a directory is emptied again if something was created
+ * in it while we were removing its contents. */
+#define REMOVE_TREE_RETRIES 3
+
+/*
+ * Remove name, relative to dirfd, and everything below it. Symlinks are
+ * never followed, and the files are unlinked with the same precautions
+ * as secure_unlink. Returns 0 on success or -1 with errno set.
+ */
+static int
+secure_remove_tree(int dirfd, const char *name)
+{
+  DIR *dir;
+  struct dirent *de;
+  struct stat stab;
+  int fd, r, e, tries;
+
+  for (tries= 0; ; tries++) {
+    fd= openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+      if (errno == ENOENT)
+        return 0;
+      if (errno != ENOTDIR && errno != ELOOP)
+        return -1;
+      /* Not a directory, or a symlink to one. */
+      if (fstatat(dirfd, name, &stab, AT_SYMLINK_NOFOLLOW))
+        return errno == ENOENT ? 0 : -1;
+      if (S_ISREG(stab.st_mode) ? (stab.st_mode & 07000) :
+          !(S_ISLNK(stab.st_mode) || S_ISFIFO(stab.st_mode) ||
+            S_ISSOCK(stab.st_mode)))
+        if (fchmodat(dirfd, name, 0600, 0))
+          return -1;
+      if (unlinkat(dirfd, name, 0) && errno != ENOENT)
+        return -1;
+      return 0;
+    }
+
+    dir= fdopendir(fd);
+    if (!dir) {
+      e= errno;
+      close(fd);
+      errno= e;
+      return -1;
+    }
+
+    r= 0;
+    while (r == 0 && (errno= 0, de= readdir(dir)) != NULL) {
+      if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+        continue;
+      r= secure_remove_tree(fd, de->d_name);
+    }
+    if (r == 0 && errno)
+      r= -1;
+    e= errno;
+    closedir(dir);
+    if (r) {
+      errno= e;
+      return -1;
+    }
+
+    if (unlinkat(dirfd, name, AT_REMOVEDIR) == 0 || errno == ENOENT)
+      return 0;
+    if ((errno != ENOTEMPTY && errno != EEXIST) ||
+        tries == REMOVE_TREE_RETRIES)
+      return -1;
+  }
+}
+
 void ensure_pathname_nonexisting(const char *pathname) {
-  int c1;
   const char *u;
+  int r;
 
   u = path_skip_slash_dotslash(pathname);
   assert(*u);
 
   debug(dbg_eachfile,"ensure_pathname_nonexisting `%s'",pathname);
-  if (!rmdir(pathname)) return; /* Deleted it OK, it was a directory. */
+  if (!dircache_rmdir(pathname)) return; /* Deleted it OK, it was a directory. */
   if (errno == ENOENT || errno == ELOOP) return;
   if (errno == ENOTDIR) {
     /* Either it's a file, or one of the path components is.  If one
@@ -588,13 +788,52 @@ void ensure_pathname_nonexisting(const char *pathname) {
   if (errno != ENOTEMPTY && errno != EEXIST) { /* Huh ? */
     ohshite(_("unable to securely remove '%.255s'"), pathname);
   }
-  c1= m_fork();
-  if (!c1) {
-    execlp(RM, "rm", "-rf", "--", pathname, NULL);
-    ohshite(_("failed to exec rm for cleanup"));
-  }
-  debug(dbg_eachfile,"ensure_pathname_nonexisting running rm -rf");
-  waitsubproc(c1,"rm cleanup",0);
+  debug(dbg_eachfile,"ensure_pathname_nonexisting removing tree");
+  r = secure_remove_tree(AT_FDCWD, pathname);
+  dircache_invalidate(pathname);
+  if (r)
+    ohshite(_("unable to securely remove '%.255s'"), pathname);
+}
+
+static void
+sync_filesystem(const char *pathname)
+{
+#ifdef HAVE_SYNCFS
+  int fd;
+
+  fd = open(pathname, O_RDONLY | O_DIRECTORY);
+  if (fd < 0)
+    ohshite(_("unable to open '%.255s'"), pathname);
+  if (syncfs(fd))
+    ohshite(_("unable to sync filesystem of '%.255s'"), pathname);
+  close(fd);
+#else
+  sync();
+#endif
+}
+
+/* With --force-unsafe-io nothing gets synced while we go, so do it once
+ * for the installation and the database filesystems at the end.
+ */
+void
+sync_unsafe_io(void)
+{
+  const char *root = *instdir ? instdir : "/";
+  struct stat rootstab, adminstab;
+
+  if (!fc_unsafe_io || f_noact)
+    return;
+
+  debug(dbg_general, "sync_unsafe_io syncing `%s' and `%s'", root, admindir);
+
+  if (stat(root, &rootstab))
+    ohshite(_("unable to stat '%.255s'"), root);
+  if (stat(admindir, &adminstab))
+    ohshite(_("unable to stat '%.255s'"), admindir);
+
+  sync_filesystem(root);
+  if (adminstab.st_dev != rootstab.st_dev)
+    sync_filesystem(admindir);
 }
 
 void log_action(const char *action, struct pkginfo *pkg) {
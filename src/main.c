@@ -46,7 +46,9 @@
 #include <dpkg/macros.h>
 #include <dpkg/dpkg.h>
 #include <dpkg/dpkg-db.h>
+#include <dpkg/ioacct.h>
 #include <dpkg/myopt.h>
+#include <dpkg/subproc.h>
 
 #include "main.h"
 #include "filesdb.h"
@@ -98,6 +100,7 @@ usage(const struct cmdinfo *ci, const char *value)
 "  -l|--list [<pattern> ...]        List packages concisely.\n"
 "  -S|--search <pattern> ...        Find package(s) owning file(s).\n"
 "  -C|--audit                       Check for broken package(s).\n"
+"  --verify [<package> ...]         Check installed files against digests.\n"
 "  --print-architecture             Print dpkg architecture.\n"
 "  --compare-versions <a> <op> <b>  Compare version numbers - see below.\n"
 "  --force-help                     Show help on forcing.\n"
@@ -130,18 +133,21 @@ usage(const struct cmdinfo *ci, const char *value)
 "  -G|--refuse-downgrade      Skip packages with earlier version than installed.\n"
 "  -B|--auto-deconfigure      Install even if it would break some other package.\n"
 "  --[no-]triggers            Skip or force consequential trigger processing.\n"
+"  --defer-triggers           Run trigger processing once, at the end of the run.\n"
 "  --no-debsig                Do not try to verify package signatures.\n"
 "  --no-act|--dry-run|--simulate\n"
 "                             Just say what we would do - don't do it.\n"
 "  -D|--debug=<octal>         Enable debugging (see -Dhelp or --debug=help).\n"
 "  --status-fd <n>            Send status change updates to file descriptor <n>.\n"
 "  --log=<filename>           Log status changes and actions to <filename>.\n"
+"  --timing                   Report how long each phase and script took.\n"
 "  --ignore-depends=<package>,...\n"
 "                             Ignore dependencies involving <package>.\n"
 "  --force-...                Override problems (see --force-help).\n"
 "  --no-force-...|--refuse-...\n"
 "                             Stop when problems encountered.\n"
 "  --abort-after <n>          Abort after encountering <n> errors.\n"
+"  --jobs <n>                 Run up to <n> postinst scripts at the same time.\n"
 "\n"), ADMINDIR);
 
   printf(_(
@@ -175,6 +181,8 @@ const struct cmdinfo *cipaction = NULL;
 int f_pending=0, f_recursive=0, f_alsoselect=1, f_skipsame=0, f_noact=0;
 int f_autodeconf=0, f_nodebsig=0;
 int f_triggers = 0;
+int f_defertriggers = 0;
+int f_jobs = 1;
 unsigned long f_debug=0;
 /* Change fc_overwrite to 1 to enable force-overwrite by default */
 int fc_downgrade=1, fc_configureany=0, fc_hold=0, fc_removereinstreq=0, fc_overwrite=0;
@@ -183,6 +191,7 @@ int fc_breaks=0, fc_badpath=0, fc_overwritediverted=0, fc_architecture=0;
 int fc_nonroot=0, fc_overwritedir=0, fc_conff_new=0, fc_conff_miss=0;
 int fc_conff_old=0, fc_conff_def=0;
 int fc_badverify = 0;
+int fc_unsafe_io = 0;
 
 int errabort = 50;
 const char *admindir= ADMINDIR;
@@ -213,6 +222,7 @@ static const struct forceinfo {
   { "overwrite-dir",       &fc_overwritedir             },
   { "architecture",        &fc_architecture             },
   { "bad-verify",          &fc_badverify                },
+  { "unsafe-io",           &fc_unsafe_io                },
   {  NULL                                               }
 };
 
@@ -415,6 +425,7 @@ static void setforce(const struct cmdinfo *cip, const char *value) {
 "  overwrite-dir [!]      Overwrite one package's directory with another's file\n"
 "  remove-reinstreq [!]   Remove packages which require installation\n"
 "  remove-essential [!]   Remove an essential package\n"
+"  unsafe-io [!]          Do not sync to disk after each change, only at the end\n"
 "\n"
 "WARNING - use of options marked [!] can seriously damage your installation.\n"
 "Forcing options marked [*] are enabled by default.\n"), DPKG);
@@ -478,6 +489,7 @@ static const struct cmdinfo cmdinfos[]= {
   ACTION( "clear-avail",                     0,  act_avclear,              updateavailable ),
   ACTION( "forget-old-unavail",              0,  act_forgetold,            forgetold       ),
   ACTION( "audit",                          'C', act_audit,                audit           ),
+  ACTION( "verify",                          0,  act_verify,               verify          ),
   ACTION( "yet-to-unpack",                   0,  act_unpackchk,            unpackchk       ),
   ACTIONBACKEND( "list",                    'l', DPKGQUERY),
   ACTIONBACKEND( "search",                  'S', DPKGQUERY),
@@ -497,6 +509,7 @@ static const struct cmdinfo cmdinfos[]= {
   { "post-invoke",       0,   1, NULL,          NULL,      set_invoke_hook, 0, &post_invoke_hooks_tail },
   { "status-fd",         0,   1, NULL,          NULL,      setpipe, 0, &status_pipes },
   { "log",               0,   1, NULL,          &log_file, NULL,    0 },
+  { "timing",            0,   0, &log_timing,   NULL,      NULL,    1 },
   { "pending",           'a', 0, &f_pending,    NULL,      NULL,    1 },
   { "recursive",         'R', 0, &f_recursive,  NULL,      NULL,    1 },
   { "no-act",            0,   0, &f_noact,      NULL,      NULL,    1 },
@@ -508,12 +521,14 @@ static const struct cmdinfo cmdinfos[]= {
   { "selected-only",     'O', 0, &f_alsoselect, NULL,      NULL,    0 },
   { "triggers",           0,  0, &f_triggers,   NULL,      NULL,    1 },
   { "no-triggers",        0,  0, &f_triggers,   NULL,      NULL,   -1 },
+  { "defer-triggers",     0,  0, &f_defertriggers, NULL,   NULL,    1 },
   /* FIXME: Remove ('N') sometime. */
   { "no-also-select",    'N', 0, &f_alsoselect, NULL,      NULL,    0 },
   { "skip-same-version", 'E', 0, &f_skipsame,   NULL,      NULL,    1 },
   { "auto-deconfigure",  'B', 0, &f_autodeconf, NULL,      NULL,    1 },
   { "root",              0,   1, NULL,          NULL,      setroot,       0 },
   { "abort-after",       0,   1, &errabort,     NULL,      setinteger,    0 },
+  { "jobs",              0,   1, &f_jobs,       NULL,      setinteger,    0 },
   { "admindir",          0,   1, NULL,          &admindir, NULL,          0 },
   { "instdir",           0,   1, NULL,          &instdir,  NULL,          0 },
   { "ignore-depends",    0,   1, NULL,          NULL,      ignoredepends, 0 },
@@ -692,10 +707,35 @@ void commandfd(const char *const *argv) {
   }
 }
 
+/* Print the file system calls made on behalf of each package as a table
+ * with --debug, and send them on the status-fd with --timing. */
+static void
+report_ioacct(const struct ioacct *acct, void *data)
+{
+  struct varbuf *vb = data;
+  unsigned long total = 0;
+  int op;
+
+  for (op = 0; op < ioacct_op_count; op++)
+    total += acct->ops[op];
+  if (!total && !acct->written)
+    return;
+
+  varbufreset(vb);
+  for (op = 0; op < ioacct_op_count; op++)
+    varbufprintf(vb, " %s %lu", ioacct_op_name(op), acct->ops[op]);
+  varbufprintf(vb, " written %lu", (unsigned long)acct->written);
+  varbufaddc(vb, '\0');
+
+  debug(dbg_general, "io %-24s%s", acct->subject, vb->buf);
+  if (log_timing)
+    statusfd_send("io: %s :%s", acct->subject, vb->buf);
+}
 
 int main(int argc, const char *const *argv) {
   jmp_buf ejbuf;
   static void (*actionfunction)(const char *const *argv);
+  struct subproc_spawn_stats spawnstats;
 
   setlocale(LC_ALL, "");
   bindtextdomain(PACKAGE, LOCALEDIR);
@@ -721,6 +761,16 @@ int main(int argc, const char *const *argv) {
 
   actionfunction(argv);
 
+  subproc_spawn_get_stats(&spawnstats);
+  debug(dbg_general, "spawned %lu subprocesses in %lu us",
+        spawnstats.spawns, spawnstats.total_usecs);
+  if (f_debug & dbg_general || log_timing) {
+    struct varbuf vb = VARBUF_INIT;
+
+    ioacct_foreach(report_ioacct, &vb);
+    varbuffree(&vb);
+  }
+
   standard_shutdown();
 
   if (is_invoke_action(cipaction->arg))
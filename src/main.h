@@ -46,6 +46,19 @@ struct perpackagestate {
 
   /* Non-NULL iff in trigproc.c:deferred. */
   struct pkg_list *trigprocdeferred;
+  /* Trigger processing was postponed by --defer-triggers. */
+  int trigprocpostponed;
+
+  /* Used by depcon.c:sortqueuebydepends. */
+  int sccindex, scclowlink;
+  bool sccstacked;
+
+  /* Used by depcon.c:depcache_lookup to remember which package satisfied
+   * an unversioned dependency on this one, and its status and version at
+   * the time. */
+  struct pkginfo *satisfiedby;
+  enum pkgstatus satisfiedstatus;
+  struct versionrevision satisfiedversion;
 };
 
 enum action {
@@ -76,6 +89,7 @@ enum action {
 	act_assertmulticonrep,
 
 	act_audit,
+	act_verify,
 	act_unpackchk,
 	act_predeppackage,
 
@@ -114,7 +128,8 @@ extern const char *const statusstrings[];
 extern const struct cmdinfo *cipaction;
 extern int f_pending, f_recursive, f_alsoselect, f_skipsame, f_noact;
 extern int f_autodeconf, f_nodebsig;
-extern int f_triggers;
+extern int f_triggers, f_defertriggers;
+extern int f_jobs;
 extern unsigned long f_debug;
 extern int fc_downgrade, fc_configureany, fc_hold, fc_removereinstreq, fc_overwrite;
 extern int fc_removeessential, fc_conflicts, fc_depends, fc_dependsversion;
@@ -122,6 +137,7 @@ extern int fc_breaks, fc_badpath, fc_overwritediverted, fc_architecture;
 extern int fc_nonroot, fc_overwritedir, fc_conff_new, fc_conff_miss;
 extern int fc_conff_old, fc_conff_def;
 extern int fc_badverify;
+extern int fc_unsafe_io;
 
 extern int abort_processing;
 extern int errabort;
@@ -168,6 +184,43 @@ void cmpversions(const char *const *argv) DPKG_ATTR_NORET;
 void limiteddescription(struct pkginfo *pkg,
                         int maxl, const char **pdesc_r, int *l_r);
 
+/* from verify.c */
+
+void verify(const char *const *argv);
+
+/* from dircache.c */
+
+struct stat;
+struct utimbuf;
+
+struct dircache_stats {
+  unsigned long syscalls;
+  unsigned long pathwalks;
+  unsigned long hits;
+  unsigned long misses;
+};
+
+void dircache_start(void);
+void dircache_stop(void);
+void dircache_invalidate(const char *pathname);
+void dircache_get_stats(struct dircache_stats *stats);
+
+int dircache_lstat(const char *pathname, struct stat *st);
+int dircache_stat(const char *pathname, struct stat *st);
+int dircache_open(const char *pathname, int flags, mode_t mode);
+int dircache_mkdir(const char *pathname, mode_t mode);
+int dircache_mknod(const char *pathname, mode_t mode, dev_t dev);
+int dircache_symlink(const char *target, const char *pathname);
+ssize_t dircache_readlink(const char *pathname, char *buf, size_t bufsize);
+int dircache_link(const char *oldpath, const char *newpath);
+int dircache_rename(const char *oldpath, const char *newpath);
+int dircache_unlink(const char *pathname);
+int dircache_rmdir(const char *pathname);
+int dircache_chown(const char *pathname, uid_t uid, gid_t gid);
+int dircache_lchown(const char *pathname, uid_t uid, gid_t gid);
+int dircache_chmod(const char *pathname, mode_t mode);
+int dircache_utime(const char *pathname, const struct utimbuf *utb);
+
 /* from select.c */
 
 void getselections(const char *const *argv);
@@ -187,6 +240,8 @@ int breakses_ok(struct pkginfo *pkg, struct varbuf *aemsgs);
 
 void deferred_remove(struct pkginfo *pkg);
 void deferred_configure(struct pkginfo *pkg);
+bool configure_jobs_running(void);
+void configure_jobs_wait(bool all);
 
 extern int sincenothing, dependtry;
 
@@ -225,7 +280,9 @@ void oldconffsetflags(const struct conffile *searchconff);
 void ensure_pathname_nonexisting(const char *pathname);
 int secure_unlink(const char *pathname);
 int secure_unlink_statted(const char *pathname, const struct stat *stab);
+int secure_unlink_prepare(const char *pathname, const struct stat *stab);
 void checkpath(void);
+void sync_unsafe_io(void);
 
 struct filenamenode *namenodetouse(struct filenamenode*, struct pkginfo*);
 
@@ -244,6 +301,8 @@ int maintainer_script_alternative(struct pkginfo *pkg,
  * trigger incorporation until after updating the package status. The effect
  * is that a package can trigger itself. */
 int maintainer_script_postinst(struct pkginfo *pkg, ...);
+pid_t maintainer_script_postinst_start(struct pkginfo *pkg, ...);
+void maintainer_script_postinst_done(struct pkginfo *pkg, int status);
 void post_postinst_tasks_core(struct pkginfo *pkg);
 
 void post_postinst_tasks(struct pkginfo *pkg, enum pkgstatus new_status);
@@ -274,6 +333,7 @@ void log_action(const char *action, struct pkginfo *pkg);
 /* from trigproc.c */
 
 void trigproc_install_hooks(void);
+void trigproc_postpone(struct pkginfo *pkg);
 void trigproc_run_deferred(void);
 void trigproc_reset_cycle(void);
 
@@ -290,6 +350,10 @@ bool depisok(struct dependency *dep, struct varbuf *whynot,
              struct pkginfo **fixbyrm, int allowunconfigd);
 struct cyclesofarlink;
 bool findbreakcycle(struct pkginfo *pkg);
+struct pkginfo *depcache_lookup(struct pkginfo *virt);
+void depcache_store(struct pkginfo *virt, struct pkginfo *provider);
+void depcache_report(void);
+void sortqueuebydepends(struct pkgqueue *q);
 void describedepcon(struct varbuf *addto, struct dependency *dep);
 
 #endif /* MAIN_H */
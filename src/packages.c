@@ -38,6 +38,7 @@
 
 #include <dpkg/dpkg.h>
 #include <dpkg/dpkg-db.h>
+#include <dpkg/ioacct.h>
 #include <dpkg/pkg-list.h>
 #include <dpkg/myopt.h>
 
@@ -96,9 +97,10 @@ void packages(const char *const *argv) {
   trigproc_install_hooks();
 
   modstatdb_init(admindir,
-                 f_noact ?    msdbrw_readonly
-               : fc_nonroot ? msdbrw_write
-               :              msdbrw_needsuperuser);
+                 (f_noact ?    msdbrw_readonly
+                : fc_nonroot ? msdbrw_write
+                :              msdbrw_needsuperuser) |
+                 (fc_unsafe_io ? msdbrw_unsafe_io : 0));
   checkpath();
   log_message("startup packages %s", cipaction->olong);
 
@@ -164,12 +166,14 @@ void packages(const char *const *argv) {
   trigproc_run_deferred();
 
   modstatdb_shutdown();
+  sync_unsafe_io();
 }
 
 void process_queue(void) {
   struct pkg_list *removeent, *rundown;
   struct pkginfo *volatile pkg;
   volatile enum action action_todo;
+  volatile int bytrig;
   jmp_buf ejbuf;
   enum istobes istobe= itb_normal;
   
@@ -208,6 +212,9 @@ void process_queue(void) {
       rundown->pkg->clientdata->istobe= istobe;
     }
   }
+
+  if (istobe == itb_installnew && cipaction->arg != act_triggers)
+    sortqueuebydepends(&queue);
   
   while ((removeent = remove_from_some_queue(&queue))) {
     pkg= removeent->pkg;
@@ -216,12 +223,14 @@ void process_queue(void) {
     if (!pkg) continue; /* duplicate, which we removed earlier */
 
     action_todo = cipaction->arg;
+    bytrig = 0;
 
     if (sincenothing++ > queue.length * 2 + 2) {
       if (progress_bytrigproc && progress_bytrigproc->trigpend_head) {
         add_to_queue(pkg);
         pkg = progress_bytrigproc;
         action_todo = act_configure;
+        bytrig = 1;
       } else {
         dependtry++;
         sincenothing = 0;
@@ -234,12 +243,15 @@ void process_queue(void) {
     if (setjmp(ejbuf)) {
       /* give up on it from the point of view of other packages, ie reset istobe */
       pkg->clientdata->istobe= itb_normal;
+      /* The cleanups do not go through the directory cache. */
+      dircache_stop();
       error_unwind(ehflag_bombout);
       if (abort_processing)
-        return;
+        break;
       continue;
     }
     push_error_handler(&ejbuf,print_error_perpackage,pkg->name);
+    ioacct_subject(pkg->name);
     switch (action_todo) {
     case act_triggers:
       if (!pkg->trigpend_head)
@@ -254,7 +266,10 @@ void process_queue(void) {
       /* Fall through. */
     case act_configure:
       /* Do whatever is most needed. */
-      if (pkg->trigpend_head)
+      if (pkg->trigpend_head && f_defertriggers && !bytrig)
+        /* Nothing is waiting on it yet, so leave it for the end. */
+        trigproc_postpone(pkg);
+      else if (pkg->trigpend_head)
         trigproc(pkg);
       else
         deferred_configure(pkg);
@@ -269,7 +284,16 @@ void process_queue(void) {
     m_output(stderr, _("<standard error>"));
     set_error_display(NULL, NULL);
     error_unwind(ehflag_normaltidy);
+    /* A postinst left running might have failed in the meantime. */
+    if (abort_processing)
+      break;
   }
+
+  configure_jobs_wait(true);
+  ioacct_subject(NULL);
+  depcache_report();
+  if (abort_processing)
+    return;
   assert(!queue.length);
 }    
 
@@ -534,7 +558,7 @@ int dependencies_ok(struct pkginfo *pkg, struct pkginfo *removing,
   struct varbuf oemsgs = VARBUF_INIT;
   struct dependency *dep;
   struct deppossi *possi, *provider;
-  struct pkginfo *possfixbytrig, *canfixbytrig;
+  struct pkginfo *possfixbytrig, *canfixbytrig, *cached;
 
   interestingwarnings= 0;
   ok= 2; /* 2=ok, 1=defer, 0=halt */
@@ -562,6 +586,15 @@ int dependencies_ok(struct pkginfo *pkg, struct pkginfo *removing,
       if (thisf > found) found= thisf;
       if (found != 3 && possi->verrel == dvr_none) {
         if (possi->ed->installed.valid) {
+          /* Those for removal depend on the package being removed, and
+           * forcing configure-any makes us queue the providers we walk
+           * past, so only the plain checks can use the cache. */
+          cached= (removing || fc_configureany) ? NULL :
+                  depcache_lookup(possi->ed);
+          if (cached) {
+            debug(dbg_depcondetail,"     provider %s already found ok",cached->name);
+            found= 3;
+          }
           for (provider= possi->ed->installed.depended;
                found != 3 && provider;
                provider= provider->nextrev) {
@@ -571,6 +604,8 @@ int dependencies_ok(struct pkginfo *pkg, struct pkginfo *removing,
                                      &possfixbytrig,
                                      &matched, NULL, &interestingwarnings, &oemsgs);
             if (thisf > found) found= thisf;
+            if (found == 3 && !removing && !fc_configureany)
+              depcache_store(possi->ed, provider->up->up);
           }
         }
       }
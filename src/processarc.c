@@ -41,6 +41,7 @@
 #include <dpkg/dpkg.h>
 #include <dpkg/dpkg-db.h>
 #include <dpkg/buffer.h>
+#include <dpkg/ioacct.h>
 #include <dpkg/subproc.h>
 #include <dpkg/tarfn.h>
 #include <dpkg/myopt.h>
@@ -89,6 +90,8 @@ void process_archive(const char *filename) {
   struct dirent *de;
   struct stat stab, oldfs;
   struct pkg_deconf_list *deconpil, *deconpiltemp;
+  struct dircache_stats dcstats;
+  struct timespan span;
   
   cleanup_pkg_failed= cleanup_conflictor_failed= 0;
   admindirlen= strlen(admindir);
@@ -105,6 +108,7 @@ void process_archive(const char *filename) {
     pfilename= filename;
   }
 
+  ioacct_count(ioacct_stat);
   if (stat(filename,&stab)) ohshite(_("cannot access archive"));
 
   if (!f_noact) {
@@ -114,19 +118,21 @@ void process_archive(const char *filename) {
       strcpy(reasmbuf,admindir);
       strcat(reasmbuf,"/" REASSEMBLETMP);
     }
+    ioacct_count(ioacct_unlink);
     if (unlink(reasmbuf) && errno != ENOENT)
       ohshite(_("error ensuring `%.250s' doesn't exist"),reasmbuf);
     push_cleanup(cu_pathname, ~0, NULL, 0, 1, (void *)reasmbuf);
-    c1= m_fork();
-    if (!c1) {
-      execlp(SPLITTER, SPLITTER, "-Qao", reasmbuf, filename, NULL);
-      ohshite(_("failed to exec dpkg-split to see if it's part of a multiparter"));
+    {
+      const char *splitargs[]= { SPLITTER, "-Qao", reasmbuf, filename, NULL };
+
+      c1= subproc_spawn(SPLITTER, SPLITTER, splitargs, NULL);
     }
     while ((r= waitpid(c1,&status,0)) == -1 && errno == EINTR);
     if (r != c1) { onerr_abort++; ohshite(_("wait for dpkg-split failed")); }
     switch (WIFEXITED(status) ? WEXITSTATUS(status) : -1) {
     case 0:
       /* It was a part - is it complete ? */
+      ioacct_count(ioacct_stat);
       if (!stat(reasmbuf,&stab)) { /* Yes. */
         filename= reasmbuf;
         pfilename= _("reassembled package file");
@@ -146,12 +152,11 @@ void process_archive(const char *filename) {
   if (!f_nodebsig && (stat(DEBSIGVERIFY, &stab)==0)) {
     printf(_("Authenticating %s ...\n"), filename);
     fflush(stdout);
-    c1 = m_fork();
-    if (!c1) {
-      execl(DEBSIGVERIFY, DEBSIGVERIFY, "-q", filename, NULL);
-      ohshite(_("failed to execl debsig-verify"));
-    } else {
+    {
+      const char *verifyargs[]= { DEBSIGVERIFY, "-q", filename, NULL };
       int status;
+
+      c1= subproc_spawn(DEBSIGVERIFY, DEBSIGVERIFY, verifyargs, NULL);
       waitpid(c1, &status, 0);
       if (!(WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
 	if (! fc_badverify) {
@@ -188,17 +193,19 @@ void process_archive(const char *filename) {
   ensure_pathname_nonexisting(cidir); cidirrest[-1]= '/';
   
   push_cleanup(cu_cidir, ~0, NULL, 0, 2, (void *)cidir, (void *)cidirrest);
-  c1= m_fork();
-  if (!c1) {
+  {
+    const char *controlargs[]= { BACKEND, "--control", filename, cidir, NULL };
+
     cidirrest[-1] = '\0';
-    execlp(BACKEND, BACKEND, "--control", filename, cidir, NULL);
-    ohshite(_("failed to exec dpkg-deb to extract control information"));
+    c1= subproc_spawn(BACKEND " --control", BACKEND, controlargs, NULL);
+    cidirrest[-1] = '/';
   }
   waitsubproc(c1,BACKEND " --control",0);
   strcpy(cidirrest,CONTROLFILE);
 
   parsedb(cidir, pdb_recordavailable | pdb_rejectstatus | pdb_ignorefiles,
           &pkg,NULL,NULL);
+  ioacct_subject(pkg->name);
   if (!pkg->files) {
     pkg->files= nfmalloc(sizeof(struct filedetails));
     pkg->files->next = NULL;
@@ -321,6 +328,7 @@ void process_archive(const char *filename) {
   newconffileslastp = &newconffiles;
   push_cleanup(cu_fileslist, ~0, NULL, 0, 0);
   strcpy(cidirrest,CONFFILESFILE);
+  ioacct_count(ioacct_open);
   conff= fopen(cidir,"r");
   if (conff) {
     push_cleanup(cu_closefile, ehflag_bombout, NULL, 0, 1, (void *)conff);
@@ -574,16 +582,23 @@ void process_archive(const char *filename) {
    * files get replaced `as we go'.
    */
 
-  m_pipe(p1);
+  /* The filesystem tarball might have been spooled for us already. */
+  p1[0]= archive_prefetch_take(filename);
+  p1[1]= -1;
+  c1= -1;
+  if (p1[0] < 0)
+    m_pipe(p1);
   push_cleanup(cu_closepipe, ehflag_bombout, NULL, 0, 1, (void *)&p1[0]);
-  c1= m_fork();
-  if (!c1) {
-    m_dup2(p1[1],1); close(p1[0]); close(p1[1]);
-    execlp(BACKEND, BACKEND, "--fsys-tarfile", filename, NULL);
-    ohshite(_("unable to exec dpkg-deb to get filesystem archive"));
+  if (p1[1] >= 0) {
+    const char *fsysargs[]= { BACKEND, "--fsys-tarfile", filename, NULL };
+    struct subproc_spawn sp = SUBPROC_SPAWN_INIT;
+
+    setcloexec(p1[0], _("<dpkg-deb --fsys-tarfile pipe>"));
+    sp.fd[1]= p1[1];
+    c1= subproc_spawn(BACKEND " --fsys-tarfile", BACKEND, fsysargs, &sp);
+    close(p1[1]);
+    p1[1] = -1;
   }
-  close(p1[1]);
-  p1[1] = -1;
 
   newfileslist = NULL;
   tc.newfilesp = &newfileslist;
@@ -591,6 +606,9 @@ void process_archive(const char *filename) {
   tc.pkg= pkg;
   tc.backendpipe= p1[0];
 
+  push_cleanup(cu_writeback, ehflag_bombout, NULL, 0, 0);
+  dircache_start();
+  timespan_start(&span, "extract", pkg->name);
   r= TarExtractor((void*)&tc, &tf);
   if (r) {
     if (errno) {
@@ -602,7 +620,19 @@ void process_archive(const char *filename) {
   fd_null_copy(p1[0], -1, _("dpkg-deb: zap possible trailing zeros"));
   close(p1[0]);
   p1[0] = -1;
-  waitsubproc(c1,BACKEND " --fsys-tarfile",PROCPIPE);
+  if (c1 >= 0)
+    waitsubproc(c1,BACKEND " --fsys-tarfile",PROCPIPE);
+  timespan_end(&span);
+
+  timespan_start(&span, "writeback", pkg->name);
+  tar_deferred_extract(newfileslist, pkg);
+  timespan_end(&span);
+
+  dircache_get_stats(&dcstats);
+  dircache_stop();
+  debug(dbg_general, "process_archive %s: %lu syscalls, %lu path walks, "
+        "%lu directory cache hits, %lu misses", pkg->name,
+        dcstats.syscalls, dcstats.pathwalks, dcstats.hits, dcstats.misses);
 
   if (oldversionstatus == stat_halfinstalled || oldversionstatus == stat_unpacked) {
     /* Packages that were in `installed' and `postinstfailed' have been reduced
@@ -651,12 +681,14 @@ void process_archive(const char *filename) {
     varbufaddstr(&fnamevb, usenode->name);
     varbufaddc(&fnamevb,0);
 
+    ioacct_count(ioacct_stat);
     if (!stat(namenode->name,&stab) && S_ISDIR(stab.st_mode)) {
       debug(dbg_eachfiledetail, "process_archive: %s is a directory",
 	    namenode->name);
       if (isdirectoryinuse(namenode,pkg)) continue;
     }
 
+    ioacct_count(ioacct_stat);
     if (lstat(fnamevb.buf, &oldfs)) {
       if (!(errno == ENOENT || errno == ELOOP || errno == ENOTDIR))
 	warning(_("could not stat old file '%.250s' so not deleting it: %s"),
@@ -664,6 +696,7 @@ void process_archive(const char *filename) {
       continue;
     }
     if (S_ISDIR(oldfs.st_mode)) {
+      ioacct_count(ioacct_unlink);
       if (rmdir(fnamevb.buf)) {
 	warning(_("unable to delete old directory '%.250s': %s"),
 	        namenode->name, strerror(errno));
@@ -705,6 +738,7 @@ void process_archive(const char *filename) {
 	  varbufaddstr(&cfilename, cfile->namenode->name);
 	  varbufaddc(&cfilename, '\0');
 
+	  ioacct_count(ioacct_stat);
 	  if (lstat(cfilename.buf, &tmp_stat) == 0) {
 	    cfile->namenode->filestat = nfmalloc(sizeof(struct stat));
 	    memcpy(cfile->namenode->filestat, &tmp_stat, sizeof(struct stat));
@@ -807,6 +841,7 @@ void process_archive(const char *filename) {
     /* Right do we have one ? */
     p++; /* skip past the full stop */
     if (!strcmp(p,LISTFILE)) continue; /* We do the list separately */
+    if (!strcmp(p,HASHFILE)) continue; /* and the hashes too */
     if (strlen(p) > MAXCONTROLFILENAME)
       ohshit(_("old version of package has overly-long info file name starting `%.250s'"),
              de->d_name);
@@ -814,11 +849,13 @@ void process_archive(const char *filename) {
     varbufaddstr(&infofnvb,de->d_name);
     varbufaddc(&infofnvb,0);
     strcpy(cidirrest,p);
+    ioacct_count(ioacct_rename);
     if (!rename(cidir,infofnvb.buf)) {
       debug(dbg_scripts, "process_archive info installed %s as %s",
             cidir, infofnvb.buf);
     } else if (errno == ENOENT) {
       /* Right, no new version. */
+      ioacct_count(ioacct_unlink);
       if (unlink(infofnvb.buf))
         ohshite(_("unable to remove obsolete info file `%.250s'"),infofnvb.buf);
       debug(dbg_scripts, "process_archive info unlinked %s",infofnvb.buf);
@@ -843,6 +880,7 @@ void process_archive(const char *filename) {
              de->d_name);
     strcpy(cidirrest,de->d_name);
     /* First we check it's not a directory. */
+    ioacct_count(ioacct_unlink);
     if (!rmdir(cidir))
       ohshit(_("package control info contained directory `%.250s'"),cidir);
     else if (errno != ENOTDIR)
@@ -855,8 +893,13 @@ void process_archive(const char *filename) {
       warning(_("package %s contained list as info file"), pkg->name);
       continue;
     }
+    if (!strcmp(de->d_name,HASHFILE)) {
+      warning(_("package %s contained hashes as info file"), pkg->name);
+      continue;
+    }
     /* Right, install it */
     newinfofilename= pkgadminfile(pkg,de->d_name);
+    ioacct_count(ioacct_rename);
     if (rename(cidir,newinfofilename))
       ohshite(_("unable to install new info file `%.250s' as `%.250s'"),
               cidir,newinfofilename);
@@ -865,6 +908,11 @@ void process_archive(const char *filename) {
   }
   pop_cleanup(ehflag_normaltidy); /* closedir */
 
+  /* Record the digests computed while unpacking in our own file, the
+   * md5sums file shipped in the package, if any, is left as it is.
+   */
+  write_filehash(pkg, newfileslist);
+
   /* Update the status database.
    * This involves copying each field across from the `available'
    * to the `installed' half of the pkg structure.
@@ -1057,6 +1105,7 @@ void process_archive(const char *filename) {
       fnvb.used= infodirbaseused;
       varbufaddstr(&fnvb,de->d_name);
       varbufaddc(&fnvb,0);
+      ioacct_count(ioacct_unlink);
       if (unlink(fnvb.buf))
         ohshite(_("unable to delete disappearing control info file `%.250s'"),fnvb.buf);
       debug(dbg_scripts, "process_archive info unlinked %s",fnvb.buf);
@@ -446,6 +446,7 @@ control_path_file(struct pkginfo *pkg, const char *control_file)
 
   /* Do not expose internal database files. */
   if (strcmp(control_file, LISTFILE) == 0 ||
+      strcmp(control_file, HASHFILE) == 0 ||
       strcmp(control_file, CONFFILESFILE) == 0)
     return;
 
@@ -501,6 +502,7 @@ control_path_pkg(struct pkginfo *pkg)
 
     /* Do not expose internal database files. */
     if (strcmp(p, LISTFILE) == 0 ||
+        strcmp(p, HASHFILE) == 0 ||
         strcmp(p, CONFFILESFILE) == 0)
       continue;
 
@@ -36,9 +36,13 @@
 #include <unistd.h>
 #include <string.h>
 #include <assert.h>
+#ifdef WITH_PTHREAD
+#include <pthread.h>
+#endif
 
 #include <dpkg/dpkg.h>
 #include <dpkg/dpkg-db.h>
+#include <dpkg/ioacct.h>
 #include <dpkg/myopt.h>
 
 #include "filesdb.h"
@@ -179,6 +183,173 @@ static void push_leftover(struct fileinlist **leftoverp,
   *leftoverp= newentry;
 }
 
+/* The unlinks of plain files do not depend on each other, so they are
+ * handed to a pool of threads, which lets the filesystem work on several
+ * of them at once. Everything else, including the decision of what to
+ * remove, stays in the main thread, and the queue is drained before any
+ * directory is removed so that directories still go after their contents.
+ */
+
+#define UNLINK_QUEUE_SIZE 256
+#define UNLINK_THREADS 8
+
+struct unlink_job {
+  char *pathname;
+  int error;
+};
+
+struct unlink_queue {
+  struct unlink_job jobs[UNLINK_QUEUE_SIZE];
+  int njobs, next, pending;
+  unsigned long files, flushes;
+#ifdef WITH_PTHREAD
+  bool quit;
+  int nthreads;
+  pthread_t threads[UNLINK_THREADS];
+  pthread_mutex_t lock;
+  pthread_cond_t work, done;
+#endif
+};
+
+static struct unlink_queue unlinkq;
+
+#ifdef WITH_PTHREAD
+static void *
+unlink_worker(void *arg)
+{
+  struct unlink_queue *q = arg;
+  int i, error;
+
+  pthread_mutex_lock(&q->lock);
+  for (;;) {
+    while (!q->quit && q->next >= q->njobs)
+      pthread_cond_wait(&q->work, &q->lock);
+    if (q->next >= q->njobs)
+      break;
+    i = q->next++;
+    pthread_mutex_unlock(&q->lock);
+
+    error = unlink(q->jobs[i].pathname) ? errno : 0;
+
+    pthread_mutex_lock(&q->lock);
+    q->jobs[i].error = error;
+    if (--q->pending == 0)
+      pthread_cond_signal(&q->done);
+  }
+  pthread_mutex_unlock(&q->lock);
+
+  return NULL;
+}
+#endif
+
+static void
+unlink_queue_start(struct unlink_queue *q)
+{
+  q->njobs = q->next = q->pending = 0;
+  q->files = q->flushes = 0;
+#ifdef WITH_PTHREAD
+  q->quit = false;
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->work, NULL);
+  pthread_cond_init(&q->done, NULL);
+  for (q->nthreads = 0; q->nthreads < UNLINK_THREADS; q->nthreads++)
+    if (pthread_create(&q->threads[q->nthreads], NULL, unlink_worker, q))
+      break;
+#endif
+}
+
+/* Wait for all the queued unlinks, and report the first one that failed. */
+static void
+unlink_queue_flush(struct unlink_queue *q)
+{
+  static struct varbuf failed;
+  int i, error = 0;
+
+  if (q->njobs == 0)
+    return;
+
+#ifdef WITH_PTHREAD
+  pthread_mutex_lock(&q->lock);
+  while (q->pending > 0)
+    pthread_cond_wait(&q->done, &q->lock);
+  pthread_mutex_unlock(&q->lock);
+#endif
+
+  for (i = 0; i < q->njobs; i++) {
+    if (q->jobs[i].error && !error) {
+      error = q->jobs[i].error;
+      varbufreset(&failed);
+      varbufaddstr(&failed, q->jobs[i].pathname);
+      varbufaddc(&failed, 0);
+    }
+    free(q->jobs[i].pathname);
+  }
+  q->njobs = q->next = 0;
+  q->flushes++;
+
+  if (error) {
+    errno = error;
+    ohshite(_("unable to securely remove '%.250s'"), failed.buf);
+  }
+}
+
+static void
+unlink_queue_add(struct unlink_queue *q, const char *pathname)
+{
+  if (q->njobs == UNLINK_QUEUE_SIZE)
+    unlink_queue_flush(q);
+
+  q->files++;
+
+#ifdef WITH_PTHREAD
+  if (q->nthreads > 0) {
+    char *copy = m_strdup(pathname);
+
+    /* The workers must not touch the counters, so charge it here. */
+    ioacct_count(ioacct_unlink);
+    pthread_mutex_lock(&q->lock);
+    q->jobs[q->njobs].pathname = copy;
+    q->jobs[q->njobs].error = 0;
+    q->njobs++;
+    q->pending++;
+    pthread_cond_signal(&q->work);
+    pthread_mutex_unlock(&q->lock);
+    return;
+  }
+#endif
+
+  if (dircache_unlink(pathname))
+    ohshite(_("unable to securely remove '%.250s'"), pathname);
+}
+
+static void
+unlink_queue_stop(struct unlink_queue *q)
+{
+#ifdef WITH_PTHREAD
+  int i;
+
+  pthread_mutex_lock(&q->lock);
+  q->quit = true;
+  pthread_cond_broadcast(&q->work);
+  pthread_mutex_unlock(&q->lock);
+  for (i = 0; i < q->nthreads; i++)
+    pthread_join(q->threads[i], NULL);
+  q->nthreads = 0;
+  pthread_cond_destroy(&q->done);
+  pthread_cond_destroy(&q->work);
+  pthread_mutex_destroy(&q->lock);
+#endif
+
+  for (; q->njobs > 0; q->njobs--)
+    free(q->jobs[q->njobs - 1].pathname);
+}
+
+static void
+cu_unlink_queue(int argc, void **argv)
+{
+  unlink_queue_stop((struct unlink_queue *)argv[0]);
+}
+
 static void removal_bulk_remove_files(
     struct pkginfo *pkg, 
     int *out_foundpostrm) 
@@ -192,11 +363,15 @@ static void removal_bulk_remove_files(
   DIR *dsd;
   struct dirent *de;
   struct stat stab;
+  struct dircache_stats dcstats;
   
     pkg->status= stat_halfinstalled;
     modstatdb_note(pkg);
     push_checkpoint(~ehflag_bombout, ehflag_normaltidy);
 
+    dircache_start();
+    unlink_queue_start(&unlinkq);
+    push_cleanup(cu_unlink_queue, ~0, NULL, 0, 1, (void *)&unlinkq);
     reversefilelist_init(&rlistit,pkg->clientdata->files);
     leftover = NULL;
     while ((namenode= reversefilelist_next(&rlistit))) {
@@ -231,7 +406,7 @@ static void removal_bulk_remove_files(
       
       fnvb.used= before;
       varbufaddc(&fnvb,0);
-      if (!stat(fnvb.buf,&stab) && S_ISDIR(stab.st_mode)) {
+      if (!dircache_stat(fnvb.buf,&stab) && S_ISDIR(stab.st_mode)) {
         debug(dbg_eachfiledetail, "removal_bulk is a directory");
         /* Only delete a directory or a link to one if we're the only
          * package which uses it.  Other files should only be listed
@@ -242,9 +417,11 @@ static void removal_bulk_remove_files(
 	  continue;
 	}
 	if (isdirectoryinuse(namenode,pkg)) continue;
+        /* Its contents might still be queued for unlinking. */
+        unlink_queue_flush(&unlinkq);
       }
       debug(dbg_eachfiledetail, "removal_bulk removing `%s'", fnvb.buf);
-      if (!rmdir(fnvb.buf) || errno == ENOENT || errno == ELOOP) continue;
+      if (!dircache_rmdir(fnvb.buf) || errno == ENOENT || errno == ELOOP) continue;
       if (errno == ENOTEMPTY || errno == EEXIST) {
 	debug(dbg_eachfiledetail, "removal_bulk `%s' was not empty, will try again later",
 	      fnvb.buf);
@@ -259,9 +436,20 @@ static void removal_bulk_remove_files(
       }
       if (errno != ENOTDIR) ohshite(_("cannot remove `%.250s'"),fnvb.buf);
       debug(dbg_eachfiledetail, "removal_bulk unlinking `%s'", fnvb.buf);
-      if (secure_unlink(fnvb.buf))
+      if (dircache_lstat(fnvb.buf, &stab) ||
+          secure_unlink_prepare(fnvb.buf, &stab))
         ohshite(_("unable to securely remove '%.250s'"), fnvb.buf);
+      unlink_queue_add(&unlinkq, fnvb.buf);
     }
+    unlink_queue_flush(&unlinkq);
+    pop_cleanup(ehflag_normaltidy); /* unlink_queue_start */
+    debug(dbg_general, "removal_bulk %s: %lu files unlinked in %lu batches",
+          pkg->name, unlinkq.files, unlinkq.flushes);
+    dircache_get_stats(&dcstats);
+    dircache_stop();
+    debug(dbg_general, "removal_bulk %s: %lu syscalls, %lu path walks, "
+          "%lu directory cache hits, %lu misses", pkg->name,
+          dcstats.syscalls, dcstats.pathwalks, dcstats.hits, dcstats.misses);
     write_filelist_except(pkg,leftover,0);
     maintainer_script_installed(pkg, POSTRMFILE, "post-removal",
                                 "remove", NULL);
@@ -292,6 +480,7 @@ static void removal_bulk_remove_files(
       fnvb.used= infodirbaseused;
       varbufaddstr(&fnvb,de->d_name);
       varbufaddc(&fnvb,0);
+      ioacct_count(ioacct_unlink);
       if (unlink(fnvb.buf))
         ohshite(_("unable to delete control info file `%.250s'"),fnvb.buf);
       debug(dbg_scripts, "removal_bulk info unlinked %s",fnvb.buf);
@@ -334,6 +523,7 @@ static void removal_bulk_remove_leftover_dirs(struct pkginfo *pkg) {
     varbufaddstr(&fnvb, usenode->name);
     varbufaddc(&fnvb,0);
 
+    ioacct_count(ioacct_stat);
     if (!stat(fnvb.buf,&stab) && S_ISDIR(stab.st_mode)) {
       debug(dbg_eachfiledetail, "removal_bulk is a directory");
       /* Only delete a directory or a link to one if we're the only
@@ -348,6 +538,7 @@ static void removal_bulk_remove_leftover_dirs(struct pkginfo *pkg) {
     }
 
     debug(dbg_eachfiledetail, "removal_bulk removing `%s'", fnvb.buf);
+    ioacct_count(ioacct_unlink);
     if (!rmdir(fnvb.buf) || errno == ENOENT || errno == ELOOP) continue;
     if (errno == ENOTEMPTY || errno == EEXIST) {
       warning(_("while removing %.250s, directory '%.250s' not empty so not removed."),
@@ -433,6 +624,7 @@ static void removal_bulk_remove_configfiles(struct pkginfo *pkg) {
             conff->name, r == -1 ? "<r==-1>" : fnvb.buf);
       if (r == -1) continue;
       conffnameused= fnvb.used-1;
+      ioacct_count(ioacct_unlink);
       if (unlink(fnvb.buf) && errno != ENOENT && errno != ENOTDIR)
         ohshite(_("cannot remove old config file `%.250s' (= `%.250s')"),
                 conff->name, fnvb.buf);
@@ -483,6 +675,7 @@ static void removal_bulk_remove_configfiles(struct pkginfo *pkg) {
         varbufaddstr(&removevb,de->d_name); varbufaddc(&removevb,0);
         debug(dbg_conffdetail, "removal_bulk conffile dsd entry removing `%s'",
               removevb.buf);
+        ioacct_count(ioacct_unlink);
         if (unlink(removevb.buf) && errno != ENOENT && errno != ENOTDIR)
           ohshite(_("cannot remove old backup config file `%.250s' (of `%.250s')"),
                   removevb.buf, conff->name);
@@ -518,6 +711,7 @@ void removal_bulk(struct pkginfo *pkg) {
     struct stat stab;
 
     postrmfilename= pkgadminfile(pkg,POSTRMFILE);
+    ioacct_count(ioacct_stat);
     if (!lstat(postrmfilename,&stab)) foundpostrm= 1;
     else if (errno == ENOENT) foundpostrm= 0;
     else ohshite(_("unable to check existence of `%.250s'"),postrmfilename);
@@ -556,12 +750,14 @@ void removal_bulk(struct pkginfo *pkg) {
     varbufaddstr(&fnvb,"." LISTFILE);
     varbufaddc(&fnvb,0);
     debug(dbg_general, "removal_bulk purge done, removing list `%s'",fnvb.buf);
+    ioacct_count(ioacct_unlink);
     if (unlink(fnvb.buf) && errno != ENOENT) ohshite(_("cannot remove old files list"));
     
     fnvb.used= pkgnameused;
     varbufaddstr(&fnvb,"." POSTRMFILE);
     varbufaddc(&fnvb,0);
     debug(dbg_general, "removal_bulk purge done, removing postrm `%s'",fnvb.buf);
+    ioacct_count(ioacct_unlink);
     if (unlink(fnvb.buf) && errno != ENOENT) ohshite(_("can't remove old postrm script"));
 
     pkg->status= stat_notinstalled;
@@ -0,0 +1,102 @@
+#!/bin/sh
+#
+# dpkg - main program for package management
+# t-jobs.sh - check when --jobs runs postinst scripts concurrently
+#
+# This is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as
+# published by the Free Software Foundation; either version 2,
+# or (at your option) any later version.
+#
+# This is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public
+# License along with dpkg; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+# Installs a few independent packages whose postinst scripts log when
+# they start and finish, and checks that with --jobs they only overlap
+# when the scripts cannot interact with the user. A terminal is provided
+# with script(1) from util-linux, the test is skipped without it.
+
+set -e
+
+dpkg=${DPKG:-./dpkg}
+dpkg_deb=${DPKG_DEB:-dpkg-deb}
+
+if ! script -qec true /dev/null </dev/null >/dev/null 2>&1; then
+	echo "script(1) cannot provide a terminal, skipping" >&2
+	exit 77
+fi
+
+tmp=$(mktemp -d "${TMPDIR:-/tmp}/t-jobs.XXXXXX")
+trap 'rm -rf "$tmp"' EXIT
+
+for name in a b c; do
+	pkg=$tmp/src/$name
+	mkdir -p "$pkg/DEBIAN"
+	cat >"$pkg/DEBIAN/control" <<EOF
+Package: t-jobs-$name
+Version: 1.0
+Architecture: all
+Maintainer: test <test@localhost>
+Description: concurrent postinst test
+EOF
+	cat >"$pkg/DEBIAN/postinst" <<EOF
+#!/bin/sh
+echo start $name >>"\$T_JOBS_LOG"
+sleep 1
+echo end $name >>"\$T_JOBS_LOG"
+EOF
+	chmod 0755 "$pkg/DEBIAN/postinst"
+	"$dpkg_deb" -b "$pkg" "$tmp/$name.deb" >/dev/null
+done
+
+# The packages ship no files, so they can be installed in / with a
+# database of their own, and the scripts need no chroot to run.
+admindir=$tmp/admindir
+T_JOBS_LOG=$tmp/log
+export T_JOBS_LOG
+
+# Installs the packages in a new database with the given command wrapping
+# dpkg, and prints the most scripts that were running at the same time.
+run()
+{
+	rm -rf "$admindir" "$T_JOBS_LOG"
+	mkdir -p "$admindir/info" "$admindir/updates" "$admindir/triggers"
+	: >"$admindir/status"
+	: >"$admindir/available"
+
+	"$@" >"$tmp/out" 2>&1 </dev/null || {
+		cat "$tmp/out" >&2
+		return 1
+	}
+
+	awk '$1 == "start" { if (++n > max) max = n }
+	     $1 == "end" { n-- }
+	     END { print max }' "$T_JOBS_LOG"
+}
+
+opts="--admindir=$admindir --force-not-root --force-bad-path"
+debs="$tmp/a.deb $tmp/b.deb $tmp/c.deb"
+
+check()
+{
+	expected=$1
+	shift
+	got=$(run "$@")
+	if [ "$got" != "$expected" ]; then
+		echo "$*: expected $expected running scripts, got $got" >&2
+		exit 1
+	fi
+}
+
+# Without a terminal the scripts run together.
+check 3 sh -c "$dpkg $opts --jobs 3 -i $debs"
+# With one they run one at a time, even if dpkg itself is not to ask
+# about conffiles, as the scripts might still prompt.
+check 1 script -qec "$dpkg $opts --jobs 3 -i $debs" /dev/null
+check 1 script -qec "$dpkg $opts --jobs 3 --force-confdef -i $debs" /dev/null
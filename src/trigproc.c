@@ -32,6 +32,7 @@
 
 #include <dpkg/dpkg.h>
 #include <dpkg/dpkg-db.h>
+#include <dpkg/ioacct.h>
 
 #include "main.h"
 #include "filesdb.h"
@@ -87,33 +88,68 @@
 
 static PKGQUEUE_DEF_INIT(deferred);
 
+/* Trigger processing runs saved by --defer-triggers. */
+static int trigproc_saved;
+
 static void
 trigproc_enqueue_deferred(struct pkginfo *pend)
 {
 	if (f_triggers < 0)
 		return;
 	ensure_package_clientdata(pend);
+	/* Had we not postponed it, the package would have to be processed
+	 * once more for this activation. */
+	if (pend->clientdata->trigprocpostponed) {
+		pend->clientdata->trigprocpostponed = 0;
+		trigproc_saved++;
+	}
 	if (pend->clientdata->trigprocdeferred)
 		return;
 	pend->clientdata->trigprocdeferred = add_to_some_queue(pend, &deferred);
 	debug(dbg_triggers, "trigproc_enqueue_deferred pend=%s", pend->name);
 }
 
+/*
+ * With --defer-triggers, trigger processing not needed to satisfy a
+ * dependency is left to trigproc_run_deferred at the end of the run, so
+ * that a package activated by many of the packages in the run only has
+ * its triggers processed once.
+ */
+void
+trigproc_postpone(struct pkginfo *pkg)
+{
+	debug(dbg_triggers, "trigproc_postpone %s", pkg->name);
+
+	trigproc_enqueue_deferred(pkg);
+	pkg->clientdata->trigprocpostponed = 1;
+}
+
 void
 trigproc_run_deferred(void)
 {
+	struct trig_activation_stats stats;
 	struct pkg_list *node;
 	struct pkginfo *pkg;
 
-	debug(dbg_triggers, "trigproc_run_deferred");
+	trig_activation_get_stats(&stats);
+	debug(dbg_triggers, "trigproc_run_deferred, %lu trigger activations "
+	      "seen, %lu recorded", stats.seen, stats.recorded);
 	while ((node = remove_from_some_queue(&deferred))) {
 		pkg = node->pkg;
 		free(node);
 		if (!pkg)
 			continue;
 		pkg->clientdata->trigprocdeferred = NULL;
+		ioacct_subject(pkg->name);
 		trigproc(pkg);
 	}
+	ioacct_subject(NULL);
+
+	if (trigproc_saved)
+		printf(ngettext("Deferring trigger processing saved %d trigger run.\n",
+		               "Deferring trigger processing saved %d trigger runs.\n",
+		               trigproc_saved), trigproc_saved);
+	trigproc_saved = 0;
 }
 
 void
@@ -275,12 +311,14 @@ trigproc(struct pkginfo *pkg)
 
 	struct trigpend *tp;
 	struct pkginfo *gaveup;
+	struct timespan span;
 
 	debug(dbg_triggers, "trigproc %s", pkg->name);
 
 	if (pkg->clientdata->trigprocdeferred)
 		pkg->clientdata->trigprocdeferred->pkg = NULL;
 	pkg->clientdata->trigprocdeferred = NULL;
+	pkg->clientdata->trigprocpostponed = 0;
 
 	if (pkg->trigpend_head) {
 		assert(pkg->status == stat_triggerspending ||
@@ -290,6 +328,7 @@ trigproc(struct pkginfo *pkg)
 		if (gaveup == pkg)
 			return;
 
+		timespan_start(&span, "trigproc", pkg->name);
 		printf(_("Processing triggers for %s ...\n"), pkg->name);
 		log_action("trigproc", pkg);
 
@@ -318,6 +357,7 @@ trigproc(struct pkginfo *pkg)
 		              stat_installed;
 
 		post_postinst_tasks_core(pkg);
+		timespan_end(&span);
 	} else {
 		/* In other branch is done by modstatdb_note. */
 		trig_clear_awaiters(pkg);
@@ -365,6 +405,7 @@ trig_transitional_activate(enum modstatdb_rw cstatus)
 		debug(dbg_triggersdetail, "trig_transitional_activate %s %s",
 		      pkg->name, statusinfos[pkg->status].name);
 		pkg->trigpend_head = NULL;
+		trig_activation_forget();
 		trig_parse_ci(pkgadminfile(pkg, TRIGGERSCIFILE),
 		              cstatus >= msdbrw_write ?
 		              transitional_interest_callback :
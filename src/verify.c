@@ -0,0 +1,407 @@
+/*
+ * dpkg - main program for package management
+ * verify.c - verify installed files against the recorded digests
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with dpkg; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <config.h>
+#include <compat.h>
+
+#include <dpkg/i18n.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef WITH_PTHREAD
+#include <pthread.h>
+#endif
+
+#include <dpkg/dpkg.h>
+#include <dpkg/dpkg-db.h>
+#include <dpkg/myopt.h>
+#include <dpkg/hash.h>
+
+#include "filesdb.h"
+#include "main.h"
+
+/* Upper bound on the number of hashing threads. */
+#define VERIFY_MAX_THREADS	16
+
+enum verify_result {
+	vr_pending,
+	vr_ok,
+	vr_changed,
+	vr_missing,
+	vr_error,
+};
+
+static const char *const verify_result_names[] = {
+	[vr_pending] = "pending",
+	[vr_ok] = "ok",
+	[vr_changed] = "changed",
+	[vr_missing] = "missing",
+	[vr_error] = "error",
+};
+
+struct verify_job {
+	struct pkginfo *pkg;
+	const char *name;
+	char *pathname;
+	const char *hash;
+	enum verify_result result;
+	int error;
+};
+
+struct verify_queue {
+	struct verify_job *jobs;
+	int njobs;
+	int next;
+#ifdef WITH_PTHREAD
+	pthread_mutex_t lock;
+	pthread_cond_t done;
+#endif
+};
+
+struct verify_worker {
+	struct verify_queue *queue;
+	unsigned char *buf;
+	size_t bufsize;
+};
+
+/*
+ * Put the calling thread in the idle I/O scheduling class, so that
+ * verifying a live system does not starve the real workload.
+ */
+static void
+verify_set_ioprio_idle(void)
+{
+#if defined(__linux__) && defined(SYS_ioprio_set)
+	const int ioprio_who_process = 1;
+	const int ioprio_class_idle = 3;
+	const int ioprio_class_shift = 13;
+
+	syscall(SYS_ioprio_set, ioprio_who_process, 0,
+	        ioprio_class_idle << ioprio_class_shift);
+#endif
+}
+
+/*
+ * Hash a single file. This runs on the worker threads, so it must not
+ * use anything that might call ohshit or touch shared state.
+ */
+static enum verify_result
+verify_file(const struct verify_job *job, unsigned char *buf, size_t bufsize,
+            int *error)
+{
+	struct hash_context ctx;
+	char hash[MD5HASHLEN + 1];
+	struct stat st;
+	ssize_t r;
+	int fd;
+
+	/* Only regular files are opened, opening a FIFO would block the
+	 * worker and opening a device might have side effects. The flags
+	 * cover the file being replaced by one in between. */
+	if (stat(job->pathname, &st) < 0) {
+		*error = errno;
+		return (errno == ENOENT) ? vr_missing : vr_error;
+	}
+	if (!S_ISREG(st.st_mode))
+		return vr_changed;
+
+	fd = open(job->pathname, O_RDONLY | O_NONBLOCK | O_NOCTTY);
+	if (fd < 0) {
+		*error = errno;
+		return (errno == ENOENT) ? vr_missing : vr_error;
+	}
+	if (fstat(fd, &st) < 0) {
+		*error = errno;
+		close(fd);
+		return vr_error;
+	}
+	if (!S_ISREG(st.st_mode)) {
+		close(fd);
+		return vr_changed;
+	}
+
+#ifdef HAVE_POSIX_FADVISE
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	hash_init(&ctx, HASH_MD5);
+	while ((r = read(fd, buf, bufsize)) != 0) {
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			*error = errno;
+			close(fd);
+			return vr_error;
+		}
+		hash_update(&ctx, buf, r);
+	}
+
+#ifdef HAVE_POSIX_FADVISE
+	/* We are not going to need this again, do not push out the pages
+	 * the rest of the system is using. */
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+	close(fd);
+
+	hash_final(&ctx, hash);
+
+	return strcmp(hash, job->hash) ? vr_changed : vr_ok;
+}
+
+#ifdef WITH_PTHREAD
+static void *
+verify_worker(void *arg)
+{
+	struct verify_worker *worker = arg;
+	struct verify_queue *queue = worker->queue;
+	enum verify_result result;
+	int i, error;
+
+	verify_set_ioprio_idle();
+
+	for (;;) {
+		pthread_mutex_lock(&queue->lock);
+		i = queue->next++;
+		pthread_mutex_unlock(&queue->lock);
+		if (i >= queue->njobs)
+			break;
+
+		error = 0;
+		result = verify_file(&queue->jobs[i], worker->buf,
+		                     worker->bufsize, &error);
+
+		pthread_mutex_lock(&queue->lock);
+		queue->jobs[i].result = result;
+		queue->jobs[i].error = error;
+		pthread_cond_broadcast(&queue->done);
+		pthread_mutex_unlock(&queue->lock);
+	}
+
+	return NULL;
+}
+#endif
+
+static int
+verify_report(struct verify_job *job)
+{
+	const char *result = verify_result_names[job->result];
+
+	statusfd_send("verify: %s : %s : %s", job->pkg->name, result, job->name);
+
+	if (job->result == vr_ok)
+		return 0;
+
+	if (job->result == vr_error)
+		warning(_("%s: unable to verify `%.250s': %s"),
+		        job->pkg->name, job->name, strerror(job->error));
+
+	printf("%s %s %s\n", result, job->pkg->name, job->name);
+
+	return 1;
+}
+
+/*
+ * Queue a job for each file of pkg which has a recorded digest.
+ */
+static void
+verify_queue_package(struct verify_queue *queue, int *maxjobs,
+                     struct pkginfo *pkg)
+{
+	struct fileinlist *file;
+	struct filenamenode *usenode;
+
+	ensure_packagefiles_available(pkg);
+
+	parse_filehash(pkg, false);
+
+	for (file = pkg->clientdata->files; file; file = file->next) {
+		struct verify_job *job;
+
+		if (!file->namenode->newhash)
+			continue;
+
+		if (queue->njobs == *maxjobs) {
+			*maxjobs = *maxjobs ? *maxjobs * 2 : 1024;
+			queue->jobs = m_realloc(queue->jobs,
+			                        *maxjobs * sizeof(*queue->jobs));
+		}
+		job = &queue->jobs[queue->njobs++];
+
+		usenode = namenodetouse(file->namenode, pkg);
+
+		job->pkg = pkg;
+		job->name = file->namenode->name;
+		job->pathname = m_malloc(strlen(instdir) +
+		                         strlen(usenode->name) + 1);
+		strcpy(job->pathname, instdir);
+		strcat(job->pathname, usenode->name);
+		job->hash = file->namenode->newhash;
+		job->result = vr_pending;
+		job->error = 0;
+	}
+}
+
+static int
+verify_nthreads(int njobs)
+{
+	long ncpus;
+
+#ifdef WITH_PTHREAD
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpus < 1)
+		ncpus = 1;
+	if (ncpus > VERIFY_MAX_THREADS)
+		ncpus = VERIFY_MAX_THREADS;
+	if (ncpus > njobs)
+		ncpus = njobs;
+#else
+	ncpus = 0;
+#endif
+
+	return ncpus;
+}
+
+/*
+ * Hash the queued files, reporting the results in queue order as soon
+ * as each one is available.
+ */
+static int
+verify_run(struct verify_queue *queue)
+{
+	const size_t bufsize = 65536;
+	unsigned char *buf;
+	int nthreads, failures = 0;
+	int i;
+
+	nthreads = verify_nthreads(queue->njobs);
+	debug(dbg_general, "verify %d files using %d threads",
+	      queue->njobs, nthreads);
+
+#ifdef WITH_PTHREAD
+	if (nthreads > 0) {
+		struct verify_worker workers[VERIFY_MAX_THREADS];
+		pthread_t threads[VERIFY_MAX_THREADS];
+		int n;
+
+		pthread_mutex_init(&queue->lock, NULL);
+		pthread_cond_init(&queue->done, NULL);
+
+		for (n = 0; n < nthreads; n++) {
+			workers[n].queue = queue;
+			workers[n].bufsize = bufsize;
+			workers[n].buf = m_malloc(bufsize);
+			if (pthread_create(&threads[n], NULL, verify_worker,
+			                   &workers[n]))
+				ohshite(_("unable to create verify thread"));
+		}
+
+		for (i = 0; i < queue->njobs; i++) {
+			pthread_mutex_lock(&queue->lock);
+			while (queue->jobs[i].result == vr_pending)
+				pthread_cond_wait(&queue->done, &queue->lock);
+			pthread_mutex_unlock(&queue->lock);
+
+			failures += verify_report(&queue->jobs[i]);
+		}
+
+		for (n = 0; n < nthreads; n++) {
+			pthread_join(threads[n], NULL);
+			free(workers[n].buf);
+		}
+
+		pthread_cond_destroy(&queue->done);
+		pthread_mutex_destroy(&queue->lock);
+
+		return failures;
+	}
+#endif
+
+	verify_set_ioprio_idle();
+	buf = m_malloc(bufsize);
+	for (i = 0; i < queue->njobs; i++) {
+		struct verify_job *job = &queue->jobs[i];
+
+		job->result = verify_file(job, buf, bufsize, &job->error);
+		failures += verify_report(job);
+	}
+	free(buf);
+
+	return failures;
+}
+
+void
+verify(const char *const *argv)
+{
+	struct verify_queue queue;
+	struct pkgiterator *it;
+	struct pkginfo *pkg;
+	const char *thisarg;
+	int maxjobs = 0, failures = 0;
+	int i;
+
+	modstatdb_init(admindir, msdbrw_readonly);
+	ensure_diversions();
+
+	queue.jobs = NULL;
+	queue.njobs = 0;
+	queue.next = 0;
+
+	if (!*argv) {
+		it = iterpkgstart();
+		while ((pkg = iterpkgnext(it))) {
+			if (pkg->status == stat_notinstalled ||
+			    pkg->status == stat_configfiles)
+				continue;
+			verify_queue_package(&queue, &maxjobs, pkg);
+		}
+		iterpkgend(it);
+	} else {
+		while ((thisarg = *argv++)) {
+			pkg = findpackage(thisarg);
+			if (pkg->status == stat_notinstalled) {
+				warning(_("package `%s' is not installed"),
+				        pkg->name);
+				failures++;
+				continue;
+			}
+			verify_queue_package(&queue, &maxjobs, pkg);
+		}
+	}
+
+	failures += verify_run(&queue);
+
+	for (i = 0; i < queue.njobs; i++)
+		free(queue.jobs[i].pathname);
+	free(queue.jobs);
+
+	m_output(stdout, _("<standard output>"));
+
+	if (failures)
+		exit(1);
+}